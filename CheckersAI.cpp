@@ -8,10 +8,55 @@
 #include <sstream>
 #include <iomanip>
 #include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <future>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <cstdio>
+#include <cmath>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "CheckersWeights.h"
 using namespace std;
 
+// The weights of CheckersWeights.h in the order of Game::eval_features()
+#define NUM_EVAL_TERMS 9
+const char *EVAL_TERM_NAMES[NUM_EVAL_TERMS] = {
+    "W_PAWN", "W_PAWN_ADVANCED", "W_FIRST_ROW", "W_KING", "W_JUMPER",
+    "W_KING_EDGE", "W_DBLCORNER", "W_ENDGAME_PAWN", "W_ENDGAME_KING"
+};
+const char *EVAL_TERM_NOTES[NUM_EVAL_TERMS] = {
+    "pawn on its own side or in the neutral rows", "pawn on the opponent's starting side",
+    "pawn still on its first row", "king anywhere on the board", "piece that can jump", "any king on the edge",
+    "endgame, losing side in a double corner", "endgame, per pawn left to the losing side",
+    "endgame, per king left to the losing side"
+};
+const int EVAL_WEIGHTS[NUM_EVAL_TERMS] = {
+    W_PAWN, W_PAWN_ADVANCED, W_FIRST_ROW, W_KING, W_JUMPER,
+    W_KING_EDGE, W_DBLCORNER, W_ENDGAME_PAWN, W_ENDGAME_KING
+};
+
 #define UINT unsigned int
+#define UINT64 uint64_t
 #define INFTY_P numeric_limits<int>::max()
 #define INFTY_N numeric_limits<int>::lowest()
 #define WHITE 0
@@ -19,12 +64,32 @@ using namespace std;
 #define HUMAN 0
 #define COMPUTER 1
 
+// Most children of a node that are evaluated as one batch
+#define BATCH_MAX_MOVES 64
+
+// Deepest ply the principal variation is kept for
+#define MAX_PLY 64
+
+// Capture exchanges: replies played out by exchange_value(), plies of quiescence() captures,
+// and how far below the best exchange on offer a quiescence capture may be before it is skipped
+#define EXCHANGE_MAX_PLIES 8
+#define QS_MAX_PLIES 16
+#define QS_PRUNE_MARGIN W_PAWN
+
+// Walk directions of the batched move generator, steps of 4 or of 3/5 up and down the board
+#define DIR_UP4 0
+#define DIR_UP35 1
+#define DIR_DOWN4 2
+#define DIR_DOWN35 3
+#define NUM_DIRS 4
+
 double cpu_time;
 int cpu_timelimit;
-int cpu_maxdepth;
 
-int root_depth;
-bool is_leaf_node;
+// Search state is per thread so several games can be searched at once (see Server)
+thread_local int cpu_maxdepth;
+thread_local int root_depth;
+thread_local bool is_leaf_node;
 volatile sig_atomic_t cpu_time_up;
 void signalHandler(int signum) {
     cpu_time_up = true;
@@ -34,1477 +99,6958 @@ void signalHandler(int signum) {
 // Single bit mask array / Piece to bitboard converter
 UINT S[32];
 
-// Lookup Tables for getting the squares relative to piece at index number
-UINT Up_Left[32] =  {
-                   99,   99,   99,   99,
-                99,    0,    1,    2,
-                    4,    5,    6,    7,
-                99,    8,    9,   10,   
-                   12,   13,   14,   15,
-                99,   16,   17,   18,   
-                   20,   21,   22,   23,
-                99,   24,   25,   26
-                };
-UINT Up_Right[32] =  {
-                   99,   99,   99,   99,
-                 0,    1,    2,    3,
-                    5,    6,    7,   99,
-                 8,    9,   10,   11,
-                   13,   14,   15,   99,
-                16,   17,   18,   19,
-                   21,   22,   23,   99,
-                24,   25,   26,   27
-                };
-UINT Down_Left[32] = {
-                    4,    5,    6,    7,
-                99,    8,    9,   10,   
-                   12,   13,   14,   15,
-                99,   16,   17,   18,   
-                   20,   21,   22,   23,
-                99,   24,   25,   26,   
-                   28,   29,   30,   31,
-                99,   99,   99,   99   
-                };
-UINT Down_Right[32] = {   
-                    5,    6,    7,   99,
-                 8,    9,   10,   11,
-                   13,   14,   15,   99,
-                16,   17,   18,   19,
-                   21,   22,   23,   99,
-                24,   25,   26,   27,
-                   29,   30,   31,   99,
-                99,   99,   99,   99
-                };
+// Wall clock in milliseconds, used for deadlines that are not driven by alarm()
+long long now_ms() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
 
+// splitmix64 finalizer
+inline UINT64 mix64(UINT64 h) {
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
 
-class Game {
+// Hash key of a position with the side to move
+inline UINT64 hash_position(UINT WP, UINT BP, UINT K, UINT turn) {
+    return mix64((((UINT64)WP << 32) | BP) + mix64(((UINT64)K << 1) | turn));
+}
 
-    // Masks for moving pieces, top/bottom row for promotions, and special positions on board
-    UINT MASK_L3, MASK_L4, MASK_L5, MASK_R3, MASK_R4, MASK_R5;
-    UINT MASK_TOP, MASK_BOT;
-    UINT MASK_EDGES;
-    UINT MASK_DBLCORNER1, MASK_DBLCORNER2;
-    
-    // Look-up tables for 16 bit numbers
-    unsigned char bitCount_Tbl[65536];
-    unsigned char msb_Tbl[65536];
-    unsigned char lsb_Tbl[65536];
+// Square order of a board reversed, the 180 degree rotation taking square i to 31 - i
+inline UINT reverse_squares(UINT b) {
+    b = ((b >> 1) & 0x55555555) | ((b & 0x55555555) << 1);
+    b = ((b >> 2) & 0x33333333) | ((b & 0x33333333) << 2);
+    b = ((b >> 4) & 0x0F0F0F0F) | ((b & 0x0F0F0F0F) << 4);
+    b = ((b >> 8) & 0x00FF00FF) | ((b & 0x00FF00FF) << 8);
+    return (b >> 16) | (b << 16);
+}
 
-    // Move class for holding information about a single move
-    struct Move {
+// A position rotated with the colours swapped and the other side to move is the same game
+// with the sign changed. Caches key both by the twin with White to move, so they hold one
+// entry for the pair, and flip what they return when the position had Black to move.
+inline UINT64 canonical_key(UINT WP, UINT BP, UINT K, UINT turn) {
+    if(turn == WHITE)
+        return hash_position(WP, BP, K, WHITE);
+    return hash_position(reverse_squares(BP), reverse_squares(WP), reverse_squares(K), WHITE);
+}
 
-        // Start and end square numbers
-        UINT start, end;
+// Score of the colour flipped twin. Win and loss scores keep their distance in plies, which
+// plain negation would shift by one since INFTY_N is one further from zero than INFTY_P
+#define MATE_BOUND 100000000
+inline int flip_score(int score) {
+    if(score > INFTY_P - MATE_BOUND || score < INFTY_N + MATE_BOUND)
+        return ~score;
+    return -score;
+}
 
-        // Bitboards of the locations that change
-        // XOR these with the current board to get next board
-        UINT WM, BM, KM;
+// Padded board layout: a ghost square after every 8 squares, so square i is bit i + i/8 and
+// bits 8, 17 and 26 stay empty. Every diagonal step is then the same shift on every row,
+// Up-Left 5 and Up-Right 4 towards bit 0, Down-Left 4 and Down-Right 5 away from it, and a
+// step off the side of the board lands on a ghost square or outside the 35 bits.
+#define PAD_SQUARES 0x7FBFDFEFFULL
+constexpr UINT64 pad_board(UINT b) {
+    return (b & 0xFFULL) | ((UINT64)(b & 0xFF00) << 1) | ((UINT64)(b & 0xFF0000) << 2) | ((UINT64)(b & 0xFF000000) << 3);
+}
+constexpr UINT unpad_board(UINT64 b) {
+    return (b & 0xFF) | ((b >> 1) & 0xFF00) | ((b >> 2) & 0xFF0000) | ((b >> 3) & 0xFF000000);
+}
+constexpr UINT pad_square(UINT i) {
+    return i + i / 8;
+}
+constexpr UINT unpad_square(UINT p) {
+    return p - p / 9;
+}
 
-        Move() {}
+//
+// TRANSPOSITION TABLE
+//
+#define TT_EXACT 0
+#define TT_LOWER 1
+#define TT_UPPER 2
+#define TT_SHARED_MAGIC "CKSHTT01"
+
+// Unpacked contents of a table entry
+struct TTData {
+    int score;
+    int depth;
+    int flag;
+    bool has_move;
+    UINT start, end;
+};
 
-        Move(UINT start, UINT end) {
-            this->start = start;
-            this->end = end;
-        }
+class TransTable {
 
-        Move(UINT start, UINT end, UINT WM, UINT BM, UINT KM) {
-            this->start = start;
-            this->end = end;
-            this->WM = WM;
-            this->BM = BM;
-            this->KM = KM;
+    // Each slot keeps key^data next to data, so an entry torn by two threads
+    // writing at once fails verification on probe instead of needing a lock
+    struct Slot {
+        atomic<UINT64> check;
+        atomic<UINT64> data;
+    };
+    static_assert(atomic<UINT64>::is_always_lock_free, "table slots must be lock free to be shared between processes");
+
+    // Start of a shared memory segment, the slots follow it
+    struct SharedHeader {
+        char magic[8];
+        atomic<UINT> age;
+        char pad[64 - 8 - sizeof(atomic<UINT>)];
+    };
+
+    // Buckets of two slots: the first is depth-preferred, the second is always replaced
+    Slot *table;
+    UINT64 bucket_mask;
+    unsigned char age;
+
+    // Set while the slots live in a POSIX shared memory segment, whose processes share one age
+    SharedHeader *shared;
+    size_t shared_bytes;
+
+    static UINT64 pack(int score, int depth, int flag, bool has_move, UINT start, UINT end, UINT age) {
+        return (UINT64)(UINT)score
+             | ((UINT64)(depth & 255) << 32)
+             | ((UINT64)flag << 40)
+             | ((UINT64)start << 42)
+             | ((UINT64)end << 47)
+             | ((UINT64)has_move << 52)
+             | ((UINT64)age << 53);
+    }
+    static void flip_entry(int &score, int &flag, UINT &start, UINT &end) {
+        score = flip_score(score);
+        if(flag != TT_EXACT)
+            flag = flag == TT_LOWER ? TT_UPPER : TT_LOWER;
+        start = 31 - start;
+        end = 31 - end;
+    }
+    static int depth_of(UINT64 data) { return (data >> 32) & 255; }
+    static UINT age_of(UINT64 data) { return (data >> 53) & 255; }
+    UINT current_age() {
+        return shared ? shared->age.load(memory_order_relaxed) & 255 : age;
+    }
+
+    // Largest power of two number of buckets that fits in bytes
+    static UINT64 buckets_for(size_t bytes) {
+        UINT64 buckets = 1;
+        while(buckets * 2 * 2 * sizeof(Slot) <= bytes)
+            buckets *= 2;
+        return buckets;
+    }
+    void release() {
+        if(shared)
+            munmap(shared, shared_bytes);
+        else
+            delete[] table;
+        table = NULL;
+        shared = NULL;
+        shared_bytes = 0;
+        bucket_mask = 0;
+    }
+
+public:
+    TransTable() {
+        table = NULL;
+        bucket_mask = 0;
+        age = 0;
+        shared = NULL;
+        shared_bytes = 0;
+    }
+    ~TransTable() {
+        release();
+    }
+
+    // Allocate the largest power of two number of buckets that fits in mb megabytes
+    void resize(size_t mb) {
+        UINT64 buckets = buckets_for(mb * 1024 * 1024);
+        release();
+        table = new Slot[buckets * 2]();
+        bucket_mask = buckets - 1;
+    }
+
+    // Maps the POSIX shared memory segment name ("/name"), creating it with mb megabytes of slots
+    // if it does not exist, otherwise taking the size it was created with. Every process mapping
+    // it reads and writes the same slots, and the key^data check rejects entries torn by another
+    // process as it does for threads. The segment stays until removed (rm /dev/shm/name).
+    bool attach_shared(const string &name, size_t mb) {
+        UINT64 buckets = buckets_for(mb * 1024 * 1024);
+        size_t bytes = sizeof(SharedHeader) + buckets * 2 * sizeof(Slot);
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if(fd >= 0) {
+            if(ftruncate(fd, bytes) != 0) {
+                ::close(fd);
+                shm_unlink(name.c_str());
+                return false;
+            }
         }
-        
-        bool operator==(const Move &other) {
-            return (start == other.start) ? (end == other.end) : false;
+        else {
+            // Created by another process, which may still be sizing it
+            fd = shm_open(name.c_str(), O_RDWR, 0600);
+            if(fd < 0)
+                return false;
+            struct stat st = {};
+            bool sized = false;
+            for(int tries = 0; tries < 100; tries++) {
+                if(fstat(fd, &st) != 0)
+                    break;
+                if((sized = st.st_size > 0))
+                    break;
+                usleep(1000);
+            }
+            if(!sized || st.st_size < (off_t)(sizeof(SharedHeader) + 2 * sizeof(Slot))) {
+                ::close(fd);
+                return false;
+            }
+            bytes = st.st_size;
+            buckets = buckets_for(bytes - sizeof(SharedHeader));
+        }
+        void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(mem == MAP_FAILED)
+            return false;
+
+        SharedHeader *header = (SharedHeader *)mem;
+        if(header->magic[0] && memcmp(header->magic, TT_SHARED_MAGIC, sizeof(header->magic)) != 0) {
+            munmap(mem, bytes);
+            return false;
+        }
+        memcpy(header->magic, TT_SHARED_MAGIC, sizeof(header->magic));
+        release();
+        shared = header;
+        shared_bytes = bytes;
+        table = (Slot *)(header + 1);
+        bucket_mask = buckets - 1;
+        return true;
+    }
+    bool is_shared() {
+        return shared != NULL;
+    }
+    void clear() {
+        for(UINT64 i = 0; i < (bucket_mask + 1) * 2; i++) {
+            table[i].check.store(0, memory_order_relaxed);
+            table[i].data.store(0, memory_order_relaxed);
         }
+    }
+    bool is_allocated() {
+        return table != NULL;
+    }
+    size_t size_bytes() {
+        return table ? (bucket_mask + 1) * 2 * sizeof(Slot) : 0;
+    }
 
-        Move& operator=(const Move &other) {
-            if (this != &other) {
-                start = other.start;
-                end = other.end;
-                WM = other.WM;
-                BM = other.BM;
-                KM = other.KM;
+    // Called at the start of every search so entries from old searches get replaced first
+    void new_search() {
+        if(shared)
+            shared->age.fetch_add(1, memory_order_relaxed);
+        else
+            age++;
+    }
+
+    // key is a canonical_key(), flipped is set when the position has Black to move so the
+    // entry is kept as its twin's: score negated, bounds swapped and squares rotated
+    bool probe(UINT64 key, TTData &out, bool flipped = false) {
+        Slot *bucket = &table[(key & bucket_mask) * 2];
+        for(int i = 0; i < 2; i++) {
+            UINT64 data = bucket[i].data.load(memory_order_relaxed);
+            if((bucket[i].check.load(memory_order_relaxed) ^ data) == key) {
+                int score = (int)(UINT)(data & 0xFFFFFFFF), flag = (data >> 40) & 3;
+                UINT start = (data >> 42) & 31, end = (data >> 47) & 31;
+                if(flipped)
+                    flip_entry(score, flag, start, end);
+                out.score = score;
+                out.depth = depth_of(data);
+                out.flag = flag;
+                out.start = start;
+                out.end = end;
+                out.has_move = (data >> 52) & 1;
+                return true;
             }
-            return *this;
         }
-    };
+        return false;
+    }
 
+    void store(UINT64 key, int score, int depth, int flag, bool has_move, UINT start, UINT end,
+               bool flipped = false) {
+        if(flipped)
+            flip_entry(score, flag, start, end);
+        Slot *bucket = &table[(key & bucket_mask) * 2];
+        UINT64 old = bucket[0].data.load(memory_order_relaxed);
+        bool same_key = (bucket[0].check.load(memory_order_relaxed) ^ old) == key;
+        UINT now = current_age();
+        Slot *slot = &bucket[1];
+        if(same_key || depth >= depth_of(old) || age_of(old) != now)
+            slot = &bucket[0];
+
+        UINT64 data = pack(score, depth, flag, has_move, start, end, now);
+        slot->check.store(key ^ data, memory_order_relaxed);
+        slot->data.store(data, memory_order_relaxed);
+    }
 
-    //
-    // GAME INFO
-    //
-    int White_Player;
-    int BlacK_Player;
-    UINT m_turn;
-    int m_turn_num;
+    // Calls f(key, data) for every entry searched at least min_depth deep, data packed as in
+    // the table with the age cleared. Entries written meanwhile by another thread may be torn.
+    template<typename F>
+    void for_each_entry(int min_depth, F f) {
+        for(UINT64 i = 0; table && i < (bucket_mask + 1) * 2; i++) {
+            UINT64 data = table[i].data.load(memory_order_relaxed);
+            UINT64 check = table[i].check.load(memory_order_relaxed);
+            if((data || check) && depth_of(data) >= min_depth)
+                f(check ^ data, data & ~(255ULL << 53));
+        }
+    }
+    // Puts back an entry given by for_each_entry() as one of the current search, keeping
+    // whichever of it and the depth-preferred slot's entry is deeper there
+    void restore(UINT64 key, UINT64 data) {
+        Slot *bucket = &table[(key & bucket_mask) * 2];
+        UINT64 old = bucket[0].data.load(memory_order_relaxed);
+        Slot *slot = &bucket[1];
+        if(depth_of(data) >= depth_of(old) || age_of(old) != current_age())
+            slot = &bucket[0];
+        data = (data & ~(255ULL << 53)) | ((UINT64)current_age() << 53);
+        slot->check.store(key ^ data, memory_order_relaxed);
+        slot->data.store(data, memory_order_relaxed);
+    }
+};
 
-    // Bitboards for White, Black, and Kings
-    UINT m_WP, m_BP, m_K;
+// One table for the whole process, shared by every game and search thread
+TransTable trans_table;
+#define TT_DEFAULT_MB 16
 
-    // Variable used for updating end position for multiple jumps in single turn
-    UINT end_temp;
+// A private table of hash_mb megabytes, or the shared segment shared_name if one is given
+bool open_trans_table(const string &shared_name, size_t hash_mb) {
+    if(shared_name.empty()) {
+        trans_table.resize(hash_mb);
+        return true;
+    }
+    string name = shared_name[0] == '/' ? shared_name : "/" + shared_name;
+    if(trans_table.attach_shared(name, hash_mb))
+        return true;
+    cerr << "Error: Cannot attach the shared table " << name << endl;
+    return false;
+}
 
-    Move best_move, best_move_temp;
-    vector<Move> m_moves;
+//
+// EVALUATION CACHE
+//
+// Static scores by position, so a leaf reached again through another move order or in the next
+// iteration skips heuristics(). Direct mapped, eight entries to a cache line, each keeping 32
+// bits of the key to check against. There is one per thread, sized by the first search on it
+// (see Game::use_eval_cache()), so memory follows the search workers and not the games hosted.
+//
+#define EVAL_CACHE_DEFAULT_KB 256
 
-public:
-    Game() {
+class EvalCache {
 
-        // Numbers representing the bit positions
-        /*
-        Black on top  
-          00  01  02  03 
-        04  05  06  07
-          08  09  10  11
-        12  13  14  15
-          16  17  18  19
-        20  21  22  23  
-          24  25  26  27 
-        28  29  30  31  
-        White on bottom 
-        */
+    struct Entry {
+        UINT check;
+        int score;
+    };
+    struct alignas(64) Line {
+        Entry entries[8];
+    };
 
-        // Bit masks from 1st to 31st bit
-        S[0] = 1;
-        for(UINT i = 1; i < 32; i++)
-            S[i] = S[i-1] * 2;
+    vector<Line> lines;
+    UINT64 entry_mask;
+    size_t kb;
 
-        // Mask for pieces MOVING DOWN
-        MASK_L3 = S[ 5] | S[ 6] | S[ 7] | S[13] | S[14] | S[15] | S[21] | S[22] | S[23];
-        MASK_L5 = S[ 0] | S[ 1] | S[ 2] | S[ 8] | S[ 9] | S[10] | S[16] | S[17] | S[18] | S[24] | S[25] | S[26];
+    // Low bits pick the entry, the high 32 bits check it. Bit 0 is set so an empty entry never matches
+    static UINT check_of(UINT64 key) { return (UINT)(key >> 32) | 1; }
 
-        // Mask for pieces MOVING UP
-        MASK_R3 = S[ 8] | S[ 9] | S[10] | S[16] | S[17] | S[18] | S[24] | S[25] | S[26];
-        MASK_R5 = S[ 5] | S[ 6] | S[ 7] | S[13] | S[14] | S[15] | S[21] | S[22] | S[23] | S[29] | S[30] | S[31];
+public:
+    // One mixing round is enough here, the side to move does not change the score
+    static UINT64 key_of(UINT WP, UINT BP, UINT K) {
+        return mix64((((UINT64)WP << 32) | BP) ^ (K * 0x9E3779B97F4A7C15ULL));
+    }
 
-        // All other possibilties are covered by LS4 (for pieces MOVING DOWN) or RS4 (for pieces MOVING UP)
+    EvalCache() {
+        entry_mask = 0;
+        kb = numeric_limits<size_t>::max();
+    }
 
-        // Masks for checking if top or bottom row
-        MASK_TOP = S[ 0] | S[ 1] | S[ 2] | S[ 3];
-        MASK_BOT = S[28] | S[29] | S[30] | S[31];
+    // Largest power of two number of lines that fits in kb kilobytes, 0 turns the cache off
+    void resize(size_t kb) {
+        this->kb = kb;
+        size_t count = 0;
+        while(kb && (count ? count * 2 : 1) * sizeof(Line) <= kb * 1024)
+            count = count ? count * 2 : 1;
+        lines.assign(count, Line());
+        entry_mask = count ? count * 8 - 1 : 0;
+    }
+    void clear() {
+        lines.assign(lines.size(), Line());
+    }
+    bool is_enabled() {
+        return !lines.empty();
+    }
+    size_t size_bytes() {
+        return lines.size() * sizeof(Line);
+    }
+    // Size last asked for, SIZE_MAX before the first resize()
+    size_t size_kb() {
+        return kb;
+    }
 
-        // Masks for edges of board
-        MASK_EDGES =   S[ 0] | S[ 1] | S[ 2] | S[ 3]
-                     | S[ 4]                 | S[11]
-                     | S[12]                 | S[19]
-                     | S[20]                 | S[27]
-                     | S[28] | S[29] | S[30] | S[31];
+    // key is the key_of() the board
+    bool probe(UINT64 key, int &score) {
+        const Entry &e = lines[(key & entry_mask) >> 3].entries[key & 7];
+        if(e.check != check_of(key))
+            return false;
+        score = e.score;
+        return true;
+    }
+    void store(UINT64 key, int score) {
+        Entry &e = lines[(key & entry_mask) >> 3].entries[key & 7];
+        e.check = check_of(key);
+        e.score = score;
+    }
+};
+thread_local EvalCache eval_cache;
 
-        // Masks for corners
-        MASK_DBLCORNER1 = S[ 0] | S[ 4];
-        MASK_DBLCORNER2 = S[27] | S[31];
 
-        // Initialize look-up tables
-        for(int bb_half = 0; bb_half < 65536; bb_half++) {
-            int bitCount = 0, msb = 255, lsb = 255;
-            for (int i = 0; i < 16; i++) {
-                if (bb_half & S[i]) {
-                    bitCount++;
-                    if (lsb == 255) {
-                        lsb = i;
-                    }
-                    msb = i;
-                }
+
+//
+// POSITION FORMATS
+//
+// PDN FEN text, e.g. "B:W21,22,K30:B1-12": side to move, then the squares of each colour,
+// numbered 1-32 (S[] index + 1) with a K prefix for kings. Ranges are accepted on input.
+//
+// Binary record, 16 bytes: WP, BP, K as little-endian 32 bit words, then the side to move
+// and the game result (RESULT_*) if it is known.
+//
+// Self-play stream (".sp"), blocks of whole games so a stream can be resumed after the last one.
+// Block header, 16 bytes: SP_MAGIC, then the games, records and payload bytes as 32 bit words,
+// the payload size with SP_COMPRESSED set if it is coded. The payload is the records, each one
+// 24 bytes: WP, BP, K, search score (White's view) as 32 bit words, side to move, game result,
+// best move start and end (S[] indices), ply as 16 bits, flags (SP_FORCED) and a zero byte.
+// A coded payload XORs every record with the one before it and lays the result out a byte
+// column at a time (every record's first byte, then every second byte...), which leaves long
+// runs of zeros, then stores runs of zeros and of literal bytes behind one count byte each.
+//
+#define FEN_MAX_LEN 160
+#define POS_RECORD_SIZE 16
+#define SP_MAGIC "CKSP"
+#define SP_HEADER_SIZE 16
+#define SP_RECORD_SIZE 24
+#define SP_COMPRESSED 0x80000000u
+#define SP_FORCED 1
+
+#define RESULT_UNKNOWN 0
+#define RESULT_WHITE_WIN 1
+#define RESULT_BLACK_WIN 2
+#define RESULT_DRAW 3
+
+// Parses the FEN starting at str, stopping at str_end, whitespace or a quote
+// Returns a pointer past the FEN, or NULL if it is malformed
+const char *parse_fen(const char *str, const char *str_end, UINT &WP, UINT &BP, UINT &K, UINT &turn) {
+    const char *p = str;
+    if(p == str_end || (*p != 'W' && *p != 'B'))
+        return NULL;
+    turn = (*p == 'W') ? 0 : 1;
+    p++;
+
+    WP = BP = K = 0;
+    bool seen[2] = {false, false};
+    while(p != str_end && *p == ':') {
+        p++;
+        if(p == str_end || (*p != 'W' && *p != 'B'))
+            return NULL;
+        int color = (*p == 'W') ? 0 : 1;
+        if(seen[color])
+            return NULL;
+        seen[color] = true;
+        UINT &pieces = color ? BP : WP;
+        p++;
+
+        // Comma separated squares, each optionally a king or a range
+        while(p != str_end && *p != ':' && *p != '.' && *p != '"' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+            bool is_king = false;
+            if(*p == 'K') {
+                is_king = true;
+                p++;
             }
-            bitCount_Tbl[bb_half] = bitCount;
-            msb_Tbl[bb_half] = msb;
-            lsb_Tbl[bb_half] = lsb;
+            int first = 0, last;
+            const char *digits = p;
+            while(p != str_end && *p >= '0' && *p <= '9')
+                first = first * 10 + (*p++ - '0');
+            if(p == digits || p - digits > 2)
+                return NULL;
+            last = first;
+            if(p != str_end && *p == '-') {
+                p++;
+                digits = p;
+                last = 0;
+                while(p != str_end && *p >= '0' && *p <= '9')
+                    last = last * 10 + (*p++ - '0');
+                if(p == digits || p - digits > 2)
+                    return NULL;
+            }
+            if(first < 1 || last > 32 || first > last)
+                return NULL;
+            for(int sq = first; sq <= last; sq++) {
+                UINT bit = 1u << (sq - 1);
+                if((WP | BP) & bit)
+                    return NULL;
+                pieces |= bit;
+                if(is_king)
+                    K |= bit;
+            }
+            if(p != str_end && *p == ',')
+                p++;
         }
     }
+    if(p != str_end && *p == '.')
+        p++;
+    return p;
+}
 
-
-    //
-    // LOADING BOARDS
-    //
-    // Initialize board
-    void init_board(UINT &WP, UINT &BP, UINT &K) {
-        WP = 0xFFF00000;
-        BP = 0x00000FFF;
-        K = 0;
+// Writes the FEN for a position into buf (at least FEN_MAX_LEN bytes, not terminated)
+// Returns the number of characters written
+int write_fen(char *buf, UINT WP, UINT BP, UINT K, UINT turn) {
+    char *p = buf;
+    *p++ = (turn == 0) ? 'W' : 'B';
+    for(int color = 0; color < 2; color++) {
+        UINT pieces = color ? BP : WP;
+        *p++ = ':';
+        *p++ = color ? 'B' : 'W';
+        bool first = true;
+        for(int i = 0; i < 32; i++) {
+            if(!(pieces & (1u << i)))
+                continue;
+            if(!first)
+                *p++ = ',';
+            first = false;
+            if(K & (1u << i))
+                *p++ = 'K';
+            int sq = i + 1;
+            if(sq >= 10)
+                *p++ = '0' + sq / 10;
+            *p++ = '0' + sq % 10;
+        }
     }
-    // Load custom board
-    void cust_board(UINT &WP, UINT &BP, UINT &K, UINT &turn, int &time) {
-        ifstream board_file;
-        string file_name;
+    return p - buf;
+}
 
-        while(true) {
-            cout << "Enter file name: ";
-            if(!(cin >> file_name)) {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            }
-            else {
-                board_file.open(file_name);
-                if(!board_file)
-                    cerr << "Error: Cannot open file." << endl;
-                else {
-                    cout << endl;
-                    break;
-                }
-            }
-        }
+inline UINT read_le32(const unsigned char *p) {
+    return (UINT)p[0] | ((UINT)p[1] << 8) | ((UINT)p[2] << 16) | ((UINT)p[3] << 24);
+}
+inline void write_le32(unsigned char *p, UINT v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
 
-        int row = 0, i = 0, piece;
-        WP = BP = K = 0;
-        while(board_file >> piece) {
-            if(piece == 0) {
-            }
-            else if(piece == 1)
-                WP |= (1 << i);
-            else if(piece == 2)
-                BP |= (1 << i);
-            else if(piece == 3) {
-                WP |= (1 << i);
-                K |= (1 << i);
-            }
-            else {
-                BP |= (1 << i);
-                K |= (1 << i);
-            }
+void encode_record(unsigned char *rec, UINT WP, UINT BP, UINT K, UINT turn, UINT result) {
+    write_le32(rec, WP);
+    write_le32(rec + 4, BP);
+    write_le32(rec + 8, K);
+    rec[12] = turn;
+    rec[13] = result;
+    rec[14] = rec[15] = 0;
+}
+void decode_record(const unsigned char *rec, UINT &WP, UINT &BP, UINT &K, UINT &turn, UINT &result) {
+    WP = read_le32(rec);
+    BP = read_le32(rec + 4);
+    K = read_le32(rec + 8);
+    turn = rec[12] & 1;
+    result = rec[13];
+}
 
-            i++;
-            if(i % 4 == 0)
-                row++;
+void encode_sp_record(unsigned char *rec, UINT WP, UINT BP, UINT K, UINT turn, UINT result, int score,
+                      UINT start, UINT end, UINT ply, UINT flags) {
+    write_le32(rec, WP);
+    write_le32(rec + 4, BP);
+    write_le32(rec + 8, K);
+    write_le32(rec + 12, score);
+    rec[16] = turn;
+    rec[17] = result;
+    rec[18] = start;
+    rec[19] = end;
+    rec[20] = ply;
+    rec[21] = ply >> 8;
+    rec[22] = flags;
+    rec[23] = 0;
+}
 
-            if(row == 8)
-                break;
+// Codes size bytes of records into out, which needs size + size / 128 + 1 bytes
+// Returns the coded size
+size_t sp_compress(const unsigned char *raw, size_t size, unsigned char *out) {
+    size_t n = size / SP_RECORD_SIZE;
+    vector<unsigned char> delta(size);
+    for(size_t r = 0; r < n; r++)
+        for(size_t c = 0; c < SP_RECORD_SIZE; c++)
+            delta[c * n + r] = raw[r * SP_RECORD_SIZE + c] ^ (r ? raw[(r - 1) * SP_RECORD_SIZE + c] : 0);
+
+    size_t used = 0;
+    for(size_t i = 0; i < size; ) {
+        size_t run = 0;
+        while(i + run < size && run < 128 && delta[i + run] == 0)
+            run++;
+        if(run) {
+            out[used++] = 0x80 | (run - 1);
+            i += run;
+            continue;
+        }
+        while(i + run < size && run < 128 && (delta[i + run] != 0 || (i + run + 1 < size && delta[i + run + 1] != 0)))
+            run++;
+        out[used++] = run - 1;
+        memcpy(out + used, &delta[i], run);
+        used += run;
+        i += run;
+    }
+    return used;
+}
+// Decodes a payload of in_size bytes into exactly raw_size bytes, false if it is corrupt
+bool sp_decompress(const unsigned char *in, size_t in_size, unsigned char *raw, size_t raw_size) {
+    vector<unsigned char> delta(raw_size);
+    size_t used = 0;
+    for(size_t i = 0; i < in_size; ) {
+        size_t run = (in[i] & 0x7F) + 1;
+        if(used + run > raw_size)
+            return false;
+        if(in[i++] & 0x80)
+            memset(&delta[used], 0, run);
+        else {
+            if(i + run > in_size)
+                return false;
+            memcpy(&delta[used], in + i, run);
+            i += run;
         }
+        used += run;
+    }
+    size_t n = raw_size / SP_RECORD_SIZE;
+    for(size_t r = 0; r < n; r++)
+        for(size_t c = 0; c < SP_RECORD_SIZE; c++)
+            raw[r * SP_RECORD_SIZE + c] = delta[c * n + r] ^ (r ? raw[(r - 1) * SP_RECORD_SIZE + c] : 0);
+    return used == raw_size;
+}
 
-        board_file >> turn;
-        turn--;
-        board_file >> time;
+// Calls f(header, payload) for every complete block of a stream, stopping at the first bad one
+// Returns the offset just past the last good block
+template<typename F>
+size_t for_each_sp_block(const unsigned char *data, size_t size, F f) {
+    size_t offset = 0;
+    while(offset + SP_HEADER_SIZE <= size && memcmp(data + offset, SP_MAGIC, 4) == 0) {
+        UINT records = read_le32(data + offset + 8), payload = read_le32(data + offset + 12) & ~SP_COMPRESSED;
+        if(offset + SP_HEADER_SIZE + payload > size || records > (1u << 24))
+            break;
+        f(data + offset, data + offset + SP_HEADER_SIZE);
+        offset += SP_HEADER_SIZE + payload;
     }
+    return offset;
+}
 
+// Read-only memory map of a whole file
+class MappedFile {
+    const char *data_ptr;
+    size_t data_size;
 
-    //
-    // HELPER FUNCTIONS FOR BIT OPERATIONS
-    //
-    UINT get_bit_count(UINT i) {
-        if (i == 0)
-            return 0;
-        return bitCount_Tbl[i & 65535] + bitCount_Tbl[(i >> 16) & 65535];
-    }
-    UINT get_lsb(UINT i) {
-        if(i & 65535)
-            return lsb_Tbl[i & 65535];
-        if((i >> 16) & 65535)
-            return lsb_Tbl[(i >> 16) & 65535] + 16;
-        return 0;
+public:
+    MappedFile() {
+        data_ptr = NULL;
+        data_size = 0;
     }
-    UINT get_msb(UINT i) {
-        if((i >> 16) & 65535)
-            return msb_Tbl[(i >> 16) & 65535] + 16;
-        if(i & 65535)
-            return msb_Tbl[i & 65535];
-        return 0;
+    ~MappedFile() {
+        close();
     }
 
-
-    //
-    // GET PIECES THAT CAN MOVE, WALK/JUMP
-    //
-    UINT get_walkers_W(UINT WP, UINT BP, UINT K) {
-        const UINT UOCC = ~(WP|BP);
-        const UINT WK = WP&K;
-        UINT walkers = ((UOCC << 4) & WP) | (((UOCC & MASK_L3) << 3) & WP) | (((UOCC & MASK_L5) << 5) & WP);
-        if(WK) 
-            walkers |= ((UOCC >> 4) & WK) | (((UOCC & MASK_R3) >> 3) & WK) | (((UOCC & MASK_R5) >> 5) & WK);
-        return walkers;
+    bool open(const string &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) < 0) {
+            ::close(fd);
+            return false;
+        }
+        data_size = st.st_size;
+        if(data_size > 0) {
+            void *map = mmap(NULL, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(map == MAP_FAILED) {
+                ::close(fd);
+                data_size = 0;
+                return false;
+            }
+            madvise(map, data_size, MADV_SEQUENTIAL);
+            data_ptr = (const char *)map;
+        }
+        ::close(fd);
+        return true;
     }
-    UINT get_walkers_B(UINT WP, UINT BP, UINT K) {
-        const UINT UOCC = ~(WP|BP);
-        const UINT BK = BP&K;
-        UINT walkers = ((UOCC >> 4) & BP) | (((UOCC & MASK_R3) >> 3) & BP) | (((UOCC & MASK_R5) >> 5) & BP);
-        if(BK)
-            walkers |= ((UOCC << 4) & BK) | (((UOCC & MASK_L3) << 3) & BK) | (((UOCC & MASK_L5) << 5) & BK);
-        return walkers;
+    void close() {
+        if(data_ptr)
+            munmap((void *)data_ptr, data_size);
+        data_ptr = NULL;
+        data_size = 0;
     }
-    UINT get_jumpers_W(UINT WP, UINT BP, UINT K) {
-        const UINT UOCC = ~(WP|BP);
-        const UINT WK = WP&K;
-        UINT jumpers = 0;
-
-        // Check empty against opponent piece, then check against own piece
-        UINT temp = (UOCC << 4) & BP;
-        if(temp)
-            jumpers |= (((temp & MASK_L3) << 3) | ((temp & MASK_L5) << 5)) & WP;
-        
-        temp = (((UOCC & MASK_L3) << 3) | ((UOCC & MASK_L5) << 5)) & BP;
-        if(temp)
-            jumpers |= (temp << 4) & WP;
 
-        if(WK) {
-            temp = (UOCC >> 4) & BP;
-            if(temp)
-                jumpers |= (((temp & MASK_R3) >> 3) | ((temp & MASK_R5) >> 5)) & WK;
+    const char *data() const { return data_ptr; }
+    size_t size() const { return data_size; }
+};
 
-            temp = (((UOCC & MASK_R3) >> 3) | ((UOCC & MASK_R5) >> 5)) & BP;
-            if(temp)
-                jumpers |= (temp >> 4) & WK;
-        }
+// Bulk loader for position files, iterated in place from the mapping without copying
+// Files ending in ".bin" hold 16 byte records, ".sp" a self-play stream (decoded a block at a
+// time), anything else one FEN per line ('#' starts a comment)
+class PositionFile {
+    MappedFile file;
+    bool binary, selfplay;
 
-        return jumpers;
+public:
+    static bool is_binary_name(const string &path) {
+        return path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+    }
+    static bool is_selfplay_name(const string &path) {
+        return path.size() >= 3 && path.compare(path.size() - 3, 3, ".sp") == 0;
     }
-    UINT get_jumpers_B(UINT WP, UINT BP, UINT K) {
-        const UINT UOCC = ~(WP|BP);
-        const UINT BK = BP&K;
-        UINT jumpers = 0;
-
-        UINT temp = (UOCC >> 4) & WP;
-        if(temp)
-            jumpers |= (((temp & MASK_R3) >> 3) | ((temp & MASK_R5) >> 5)) & BP;
-        
-        temp = (((UOCC & MASK_R3) >> 3) | ((UOCC & MASK_R5) >> 5)) & WP;
-        if(temp)
-            jumpers |= (temp >> 4) & BP;
-        
-        if(BK) {
-            temp = (UOCC << 4) & WP;
-            if(temp)
-                jumpers |= (((temp & MASK_L3) << 3) | ((temp & MASK_L5) << 5)) & BK;
 
-            temp = (((UOCC & MASK_L3) << 3) | ((UOCC & MASK_L5) << 5)) & WP;
-            if(temp)
-                jumpers |= (temp << 4) & BK;
-        }
+    bool open(const string &path) {
+        binary = is_binary_name(path);
+        selfplay = is_selfplay_name(path);
+        return file.open(path);
+    }
+    bool is_binary() const {
+        return binary;
+    }
 
-        return jumpers;
+    // Direct access to binary records, for splitting a file between threads
+    size_t num_records() const {
+        return binary ? file.size() / POS_RECORD_SIZE : 0;
+    }
+    const unsigned char *record(size_t i) const {
+        return (const unsigned char *)file.data() + i * POS_RECORD_SIZE;
     }
 
-    //
-    // GET ALL LEGAL MOVES, WALKS/JUMPS
-    //
-    void get_walks_W(UINT walker_num, UINT WP, UINT BP, UINT K, vector<Move> &moves) {
-        UINT end;
-        UINT WM, KM;
-        UINT walker_bb = S[walker_num];
-        UINT UOCC = ~(WP|BP);
-        UINT is_king = walker_bb & K;
-        UINT next_sq, next_sq_bb;
-        UINT is_empty, is_promote;
-
-        // Check if pieces can move Up-Left
-        next_sq = Up_Left[walker_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_empty = next_sq_bb & UOCC;
-            if(is_empty) {
-                WM = walker_bb | next_sq_bb;
-                if(is_king)
-                    KM = WM;
-                else {
-                    is_promote = next_sq_bb & MASK_TOP;
-                    if(is_promote)
-                        KM = next_sq_bb;
-                    else
-                        KM = 0;
-                }
-                moves.push_back(Move(walker_num,next_sq,WM,0,KM));
+    // Calls f(WP, BP, K, turn, result) for every position and returns how many there were
+    // Malformed FEN lines (or self-play blocks) are skipped and counted in bad_lines
+    template<typename F>
+    size_t for_each(F f, size_t *bad_lines = NULL) const {
+        size_t count = 0, bad = 0;
+        UINT WP, BP, K, turn, result;
+        if(binary) {
+            const unsigned char *rec = (const unsigned char *)file.data();
+            size_t n = file.size() / POS_RECORD_SIZE;
+            for(size_t i = 0; i < n; i++, rec += POS_RECORD_SIZE) {
+                decode_record(rec, WP, BP, K, turn, result);
+                f(WP, BP, K, turn, result);
             }
+            count = n;
         }
-
-        // Check if pieces can move Up-Right
-        next_sq = Up_Right[walker_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_empty = next_sq_bb & UOCC;
-            if(is_empty) {
-                WM = walker_bb | next_sq_bb;
-                if(is_king)
-                    KM = WM;
+        else if(selfplay) {
+            vector<unsigned char> raw;
+            for_each_sp_block((const unsigned char *)file.data(), file.size(),
+                              [&](const unsigned char *header, const unsigned char *payload) {
+                size_t size = (size_t)read_le32(header + 8) * SP_RECORD_SIZE;
+                UINT payload_size = read_le32(header + 12);
+                raw.resize(size);
+                if(payload_size & SP_COMPRESSED) {
+                    if(!sp_decompress(payload, payload_size & ~SP_COMPRESSED, raw.data(), size)) {
+                        bad++;
+                        return;
+                    }
+                }
+                else if(payload_size == size)
+                    memcpy(raw.data(), payload, size);
                 else {
-                    is_promote = next_sq_bb & MASK_TOP;
-                    if(is_promote)
-                        KM = next_sq_bb;
+                    bad++;
+                    return;
+                }
+                for(size_t i = 0; i < size; i += SP_RECORD_SIZE) {
+                    const unsigned char *rec = raw.data() + i;
+                    f(read_le32(rec), read_le32(rec + 4), read_le32(rec + 8), (UINT)(rec[16] & 1), (UINT)rec[17]);
+                    count++;
+                }
+            });
+        }
+        else {
+            const char *p = file.data(), *file_end = p + file.size();
+            while(p < file_end) {
+                const char *line_end = (const char *)memchr(p, '\n', file_end - p);
+                if(!line_end)
+                    line_end = file_end;
+                while(p < line_end && (*p == ' ' || *p == '\t'))
+                    p++;
+                if(p < line_end && *p != '#' && *p != '\r') {
+                    if(parse_fen(p, line_end, WP, BP, K, turn)) {
+                        f(WP, BP, K, turn, (UINT)RESULT_UNKNOWN);
+                        count++;
+                    }
                     else
-                        KM = 0;
+                        bad++;
                 }
-                moves.push_back(Move(walker_num,next_sq,WM,0,KM));
+                p = line_end + 1;
             }
         }
+        if(bad_lines)
+            *bad_lines = bad;
+        return count;
+    }
+};
 
-        // Check if pieces are Kings and then check Down-Left and Down-Right
-        if(is_king) {
-            next_sq = Down_Left[walker_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_empty = next_sq_bb & UOCC;
-                if(is_empty) {
-                    WM = walker_bb | next_sq_bb;
-                    KM = WM;
-                    moves.push_back(Move(walker_num,next_sq,WM,0,KM));
-                }
-            }
+//
+// TABLE FILES
+//
+// Deep transposition table entries saved to disk, so a restarted engine starts warm on the
+// positions it has seen. The root of every search is stored at the depth it completed, so
+// learned root results come back with the rest. Header, 40 bytes: TT_FILE_MAGIC, then the
+// version and entry size as 32 bit words, the entry count, checksum and weights_hash() as 64
+// bit words, all little-endian. Each entry is the key and the packed TransTable data as 64 bit
+// words. The checksum chains mix64() over every word of the entries. TT_FILE_VERSION changes
+// whenever TransTable::pack() or canonical_key() do, since old entries would then mean
+// something else, and scores from other weights are refused by the hash.
+//
+#define TT_FILE_MAGIC "CKTTFILE"
+#define TT_FILE_VERSION 2
+#define TT_FILE_HEADER_SIZE 40
+#define TT_FILE_ENTRY_SIZE 16
+#define TT_FILE_MIN_DEPTH 6
+#define TT_FILE_SAVE_SECONDS 300
+
+inline UINT64 read_le64(const unsigned char *p) {
+    return (UINT64)read_le32(p) | ((UINT64)read_le32(p + 4) << 32);
+}
+inline void write_le64(unsigned char *p, UINT64 v) {
+    write_le32(p, (UINT)v);
+    write_le32(p + 4, (UINT)(v >> 32));
+}
 
-            next_sq = Down_Right[walker_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_empty = next_sq_bb & UOCC;
-                if(is_empty) {
-                    WM = walker_bb | next_sq_bb;
-                    KM = WM;
-                    moves.push_back(Move(walker_num,next_sq,WM,0,KM));
-                }
-            }
+// Identifies the EVAL_WEIGHTS the saved scores were searched with
+UINT64 weights_hash() {
+    UINT64 h = NUM_EVAL_TERMS;
+    for(int i = 0; i < NUM_EVAL_TERMS; i++)
+        h = mix64(h ^ (UINT)EVAL_WEIGHTS[i]);
+    return h;
+}
+
+// Writes the entries of trans_table searched at least min_depth deep to path, through a
+// temporary file renamed over it so a reader never sees half a file
+// Returns the number of entries saved, -1 if the file cannot be written
+long long save_table_file(const string &path, int min_depth = TT_FILE_MIN_DEPTH) {
+    string tmp = path + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if(!out)
+        return -1;
+    unsigned char header[TT_FILE_HEADER_SIZE] = {};
+    fwrite(header, 1, sizeof(header), out);
+
+    UINT64 count = 0, checksum = 0;
+    vector<unsigned char> buf;
+    trans_table.for_each_entry(min_depth, [&](UINT64 key, UINT64 data) {
+        unsigned char entry[TT_FILE_ENTRY_SIZE];
+        write_le64(entry, key);
+        write_le64(entry + 8, data);
+        buf.insert(buf.end(), entry, entry + sizeof(entry));
+        checksum = mix64(mix64(checksum ^ key) ^ data);
+        count++;
+        if(buf.size() >= 65536) {
+            fwrite(buf.data(), 1, buf.size(), out);
+            buf.clear();
         }
+    });
+    fwrite(buf.data(), 1, buf.size(), out);
+
+    memcpy(header, TT_FILE_MAGIC, 8);
+    write_le32(header + 8, TT_FILE_VERSION);
+    write_le32(header + 12, TT_FILE_ENTRY_SIZE);
+    write_le64(header + 16, count);
+    write_le64(header + 24, checksum);
+    write_le64(header + 32, weights_hash());
+    fseek(out, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), out);
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return -1;
     }
-    void get_walks_B(UINT walker_num, UINT WP, UINT BP, UINT K, vector<Move> &moves) {
-        UINT BM, KM;
-        UINT walker_bb = S[walker_num];
-        UINT UOCC = ~(WP|BP);
-        UINT is_king = walker_bb & K;
-        UINT next_sq, next_sq_bb;
-        UINT is_empty, is_promote;
+    return count;
+}
 
-        // Check if pieces can move Down-Left
-        next_sq = Down_Left[walker_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_empty = next_sq_bb & UOCC;
-            if(is_empty) {
-                BM = walker_bb | next_sq_bb;
-                if(is_king)
-                    KM = BM;
-                else {
-                    is_promote = next_sq_bb & MASK_BOT;
-                    if(is_promote)
-                        KM = next_sq_bb;
-                    else 
-                        KM = 0;
-                }
-                moves.push_back(Move(walker_num,next_sq,0,BM,KM));
-            }
-        }
+// Maps path and restores its entries into trans_table, after checking the magic, version,
+// weights, size and checksum. Nothing is restored from a file that fails any of them.
+// Returns the number of entries restored, -1 with why in error if the file was refused
+long long load_table_file(const string &path, string &error) {
+    MappedFile file;
+    if(!file.open(path)) {
+        error = "cannot open " + path;
+        return -1;
+    }
+    const unsigned char *p = (const unsigned char *)file.data();
+    if(file.size() < TT_FILE_HEADER_SIZE || memcmp(p, TT_FILE_MAGIC, 8) != 0) {
+        error = path + " is not a table file";
+        return -1;
+    }
+    if(read_le32(p + 8) != TT_FILE_VERSION || read_le32(p + 12) != TT_FILE_ENTRY_SIZE) {
+        error = path + " is table file version " + to_string(read_le32(p + 8)) + ", this engine reads version " + to_string(TT_FILE_VERSION);
+        return -1;
+    }
+    if(read_le64(p + 32) != weights_hash()) {
+        error = path + " was searched with other evaluation weights";
+        return -1;
+    }
+    UINT64 count = read_le64(p + 16);
+    if(count != (file.size() - TT_FILE_HEADER_SIZE) / TT_FILE_ENTRY_SIZE || (file.size() - TT_FILE_HEADER_SIZE) % TT_FILE_ENTRY_SIZE) {
+        error = path + " is truncated";
+        return -1;
+    }
+    const unsigned char *entries = p + TT_FILE_HEADER_SIZE;
+    UINT64 checksum = 0;
+    for(UINT64 i = 0; i < count; i++)
+        checksum = mix64(mix64(checksum ^ read_le64(entries + i * TT_FILE_ENTRY_SIZE)) ^ read_le64(entries + i * TT_FILE_ENTRY_SIZE + 8));
+    if(checksum != read_le64(p + 24)) {
+        error = path + " fails its checksum";
+        return -1;
+    }
+    for(UINT64 i = 0; i < count; i++)
+        trans_table.restore(read_le64(entries + i * TT_FILE_ENTRY_SIZE), read_le64(entries + i * TT_FILE_ENTRY_SIZE + 8));
+    return count;
+}
 
-        // Check if pieces can move Down-Right
-        next_sq = Down_Right[walker_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_empty = next_sq_bb & UOCC;
-            if(is_empty) {
-                BM = walker_bb | next_sq_bb;
-                if(is_king)
-                    KM = BM;
-                else {
-                    is_promote = next_sq_bb & MASK_BOT;
-                    if(is_promote)
-                        KM = next_sq_bb;
-                    else 
-                        KM = 0;
-                }
-                moves.push_back(Move(walker_num,next_sq,0,BM,KM));
-            }
-        }
+// Loads path into trans_table if it exists, a missing or refused file leaves a cold start
+void open_table_file(const string &path) {
+    if(path.empty() || access(path.c_str(), F_OK) != 0)
+        return;
+    string error;
+    long long count = load_table_file(path, error);
+    if(count < 0)
+        cerr << "Warning: " << error << ", starting with an empty table" << endl;
+    else
+        cerr << "Loaded " << count << " table entries from " << path << endl;
+}
+void close_table_file(const string &path) {
+    if(!path.empty() && save_table_file(path) < 0)
+        cerr << "Error: Cannot write " << path << endl;
+}
 
-        // Check if pieces are Kings and then check Up-Left and Up-Right
-        if(is_king) {
-            next_sq = Up_Left[walker_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_empty = next_sq_bb & UOCC;
-                if(is_empty) {
-                    BM = walker_bb | next_sq_bb;
-                    KM = BM;
-                    moves.push_back(Move(walker_num,next_sq,0,BM,KM));
-                }
-            }
 
-            next_sq = Up_Right[walker_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_empty = next_sq_bb & UOCC;
-                if(is_empty) {
-                    BM = walker_bb | next_sq_bb;
-                    KM = BM;
-                    moves.push_back(Move(walker_num,next_sq,0,BM,KM));
-                }
-            }
-        }
+//
+// GAME CLOCKS
+//
+// Base time plus an increment per move, or the base time again every period_moves moves
+// (moves-in-time). budget() splits what is left on a side's clock into a soft target for one
+// move, which the search may run past while its best move keeps changing, and a hard limit.
+//
+#define CLOCK_MARGIN_MS 50
+
+class GameClock {
+    string spec;
+    long long base_ms, inc_ms;
+    int period_moves;
+    long long remaining_ms[2];
+    int moves_left[2];
+    long long turn_start;
+
+public:
+    GameClock() {
+        base_ms = inc_ms = 0;
+        period_moves = 0;
+        remaining_ms[0] = remaining_ms[1] = 0;
+        moves_left[0] = moves_left[1] = 0;
+        turn_start = 0;
     }
-    void get_jumps_W(UINT jumper_num, UINT WP, UINT BP, UINT K, UINT WP_orig, UINT BP_orig, UINT K_orig, UINT start, UINT &end, vector<Move> &moves) {
-        UINT WM, BM, KM;
-        UINT jumper_bb = S[jumper_num];
-        UINT UOCC = ~(WP|BP);
-        UINT is_king = jumper_bb & K;
-        UINT next_sq, next_sq_bb;
-        UINT jump_sq, jump_sq_bb;
-        UINT is_opp, is_empty, is_promote;
-        bool same_turn = true;
-        Move move;
 
-        // Check if pieces can jump Up-Left
-        next_sq = Up_Left[jumper_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_opp = next_sq_bb & BP;
-            if(is_opp) {
-                jump_sq = Up_Left[get_msb(next_sq_bb)];
-                if(jump_sq != 99) {
-                    jump_sq_bb = S[jump_sq];
-                    is_empty = jump_sq_bb & UOCC;
-                    if(is_empty) {
-                        end = jump_sq;
-                        WM = jumper_bb | jump_sq_bb;
-                        BM = next_sq_bb;
-                        KM = BM & K;
-                        // Check for a promotion if on other size
-                        if(!is_king) {
-                            is_promote = jump_sq_bb & MASK_TOP;
-                            if(is_promote) {
-                                KM |= jump_sq_bb;
-                                same_turn = false;
-                            }
-                            else {
-                                get_jumps_W(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);  // K^0 = K
-                                same_turn = false;
-                            }
-                        }
-                        else {
-                            KM |= WM;
-                            get_jumps_W(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
+    // "[moves/]seconds[+increment]", e.g. "300+3" or "40/600", also the PDN TimeControl tag
+    bool parse(const string &text) {
+        int moves = 0;
+        double base = 0, inc = 0;
+        const char *p = text.c_str();
+        char *end;
+        if(strchr(p, '/')) {
+            moves = strtol(p, &end, 10);
+            if(*end != '/' || moves <= 0)
+                return false;
+            p = end + 1;
         }
-        if(!same_turn) {
-            move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-            if(find(moves.begin(),moves.end(),move) == moves.end())
-                moves.push_back(move);
-        }
-
-        // Check if pieces can jump Up-Right
-        next_sq = Up_Right[jumper_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_opp = next_sq_bb & BP;
-            if(is_opp) {
-                jump_sq = Up_Right[get_msb(next_sq_bb)];
-                if(jump_sq != 99) {
-                    jump_sq_bb = S[jump_sq];
-                    is_empty = jump_sq_bb & UOCC;
-                    if(is_empty) {
-                        end = jump_sq;
-                        WM = jumper_bb | jump_sq_bb;
-                        BM = next_sq_bb;
-                        KM = BM & K;
-                        if(!is_king) {
-                            is_promote = jump_sq_bb & MASK_TOP;
-                            if(is_promote) {
-                                KM |= jump_sq_bb;
-                                same_turn = false;
-                            }
-                            else {
-                                get_jumps_W(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                                same_turn = false;
-                            }
-                        }
-                        else {
-                            KM |= WM;
-                            get_jumps_W(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
-        }
-        if(!same_turn) {
-            move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-            if(find(moves.begin(),moves.end(),move) == moves.end())
-                moves.push_back(move);
-        }
-
-        // Check if pieces are Kings and then check Down-Left and Down-Right
-        if(is_king) {
-            next_sq = Down_Left[jumper_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_opp = next_sq_bb & BP;
-                if(is_opp) {
-                    jump_sq = Down_Left[get_msb(next_sq_bb)];
-                    if(jump_sq != 99) {
-                        jump_sq_bb = S[jump_sq];
-                        is_empty = jump_sq_bb & UOCC;
-                        if(is_empty) {
-                            end = jump_sq;
-                            WM = jumper_bb | jump_sq_bb;
-                            BM = next_sq_bb;
-                            KM = WM | (BM & K);
-                            get_jumps_W(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
-            if(!same_turn) {
-                move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-                if(find(moves.begin(),moves.end(),move) == moves.end())
-                    moves.push_back(move);
-            }
-
-            next_sq = Down_Right[jumper_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_opp = next_sq_bb & BP;
-                if(is_opp) {
-                    jump_sq = Down_Right[get_msb(next_sq_bb)];
-                    if(jump_sq != 99) {
-                        jump_sq_bb = S[jump_sq];
-                        is_empty = jump_sq_bb & UOCC;
-                        if(is_empty) {
-                            end = jump_sq;
-                            WM = jumper_bb | jump_sq_bb;
-                            BM = next_sq_bb;
-                            KM = WM | (BM & K);
-                            get_jumps_W(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
-            if(!same_turn) {
-                move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-                if(find(moves.begin(),moves.end(),move) == moves.end())
-                    moves.push_back(move);
-            }
+        base = strtod(p, &end);
+        if(end == p || base <= 0)
+            return false;
+        if(*end == '+') {
+            p = end + 1;
+            inc = strtod(p, &end);
+            if(end == p || inc < 0)
+                return false;
         }
+        if(*end)
+            return false;
+        spec = text;
+        base_ms = base * 1000;
+        inc_ms = inc * 1000;
+        period_moves = moves;
+        reset();
+        return true;
     }
-    void get_jumps_B(UINT jumper_num, UINT WP, UINT BP, UINT K, UINT WP_orig, UINT BP_orig, UINT K_orig, UINT start, UINT &end, vector<Move> &moves) {
-        UINT WM, BM, KM;
-        UINT jumper_bb = S[jumper_num];
-        UINT UOCC = ~(WP|BP);
-        UINT is_king = jumper_bb & K;
-        UINT next_sq, next_sq_bb;
-        UINT jump_sq, jump_sq_bb;
-        UINT is_opp, is_empty, is_promote;
-        bool same_turn = true;
-        Move move;
-
-        // Check if pieces can jump Down-Left
-        next_sq = Down_Left[jumper_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_opp = next_sq_bb & WP;
-            if(is_opp) {
-                jump_sq = Down_Left[get_msb(next_sq_bb)];
-                if(jump_sq != 99) {
-                    jump_sq_bb = S[jump_sq];
-                    is_empty = jump_sq_bb & UOCC;
-                    if(is_empty) {
-                        end = jump_sq;
-                        BM = jumper_bb | jump_sq_bb;
-                        WM = next_sq_bb;
-                        KM = WM & K;
-                        if(!is_king) {
-                            is_promote = jump_sq_bb & MASK_BOT;
-                            if(is_promote) {
-                                KM |= jump_sq_bb;
-                                same_turn = false;
-                            }
-                            else {
-                                get_jumps_B(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);  // K^0 = K
-                                same_turn = false;
-                            }
-                        }
-                        else {
-                            KM |= BM;
-                            get_jumps_B(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
+    void reset() {
+        for(int side = 0; side < 2; side++) {
+            remaining_ms[side] = base_ms;
+            moves_left[side] = period_moves;
         }
-        if(!same_turn) {
-            move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-            if(find(moves.begin(),moves.end(),move) == moves.end())
-                moves.push_back(move);
-        }
-
-        // Check if pieces can jump Down-Right
-        next_sq = Down_Right[jumper_num];
-        if(next_sq != 99) {
-            next_sq_bb = S[next_sq];
-            is_opp = next_sq_bb & WP;
-            if(is_opp) {
-                jump_sq = Down_Right[get_msb(next_sq_bb)];
-                if(jump_sq != 99) {
-                    jump_sq_bb = S[jump_sq];
-                    is_empty = jump_sq_bb & UOCC;
-                    if(is_empty) {
-                        end = jump_sq;
-                        BM = jumper_bb | jump_sq_bb;
-                        WM = next_sq_bb;
-                        KM = WM & K;
-                        if(!is_king) {
-                            is_promote = jump_sq_bb & MASK_BOT;
-                            if(is_promote) {
-                                KM |= jump_sq_bb;
-                                same_turn = false;
-                            }
-                            else {
-                                get_jumps_B(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                                same_turn = false;
-                            }
-                        }
-                        else {
-                            KM |= BM;
-                            get_jumps_B(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
+    }
+    bool enabled() { return base_ms > 0; }
+    const string &time_control() { return spec; }
+    long long remaining(UINT turn) { return remaining_ms[turn]; }
+
+    // pieces stands in for the phase, a full board expects a longer game ahead than an endgame
+    void budget(UINT turn, int pieces, long long &soft, long long &hard) {
+        long long left = ::max(remaining_ms[turn] - CLOCK_MARGIN_MS, 0LL);
+        int moves_to_go = period_moves ? moves_left[turn] : 12 + pieces;
+        if(moves_to_go <= 1) {
+            soft = hard = left;
+            return;
         }
-        if(!same_turn) {
-            move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-            if(find(moves.begin(),moves.end(),move) == moves.end())
-                moves.push_back(move);
-        }
-
-        // Check if pieces are Kings and then check Up-Left and Up-Right
-        if(is_king) {
-            next_sq = Up_Left[jumper_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_opp = next_sq_bb & WP;
-                if(is_opp) {
-                    jump_sq = Up_Left[get_msb(next_sq_bb)];
-                    if(jump_sq != 99) {
-                        jump_sq_bb = S[jump_sq];
-                        is_empty = jump_sq_bb & UOCC;
-                        if(is_empty) {
-                            end = jump_sq;
-                            BM = jumper_bb | jump_sq_bb;
-                            WM = next_sq_bb;
-                            KM = BM | (WM & K);
-                            get_jumps_B(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
-            if(!same_turn) {
-                move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-                if(find(moves.begin(),moves.end(),move) == moves.end())
-                  moves.push_back(move);
-            }
-
-            next_sq = Up_Right[jumper_num];
-            if(next_sq != 99) {
-                next_sq_bb = S[next_sq];
-                is_opp = next_sq_bb & WP;
-                if(is_opp) {
-                    jump_sq = Up_Right[get_msb(next_sq_bb)];
-                    if(jump_sq != 99) {
-                        jump_sq_bb = S[jump_sq];
-                        is_empty = jump_sq_bb & UOCC;
-                        if(is_empty) {
-                            end = jump_sq;
-                            BM = jumper_bb | jump_sq_bb;
-                            WM = next_sq_bb;
-                            KM = BM | (WM & K);
-                            get_jumps_B(jump_sq,WP^WM,BP^BM,K^KM,WP_orig,BP_orig,K_orig,start,end,moves);
-                            same_turn = false;
-                        }
-                    }
-                }
-            }
-            if(!same_turn) {
-                move = Move(start,end,WP_orig^WP^WM,BP_orig^BP^BM,K_orig^K^KM);
-                if(find(moves.begin(),moves.end(),move) == moves.end())
-                    moves.push_back(move);
-            }
+        soft = left / moves_to_go + inc_ms * 3 / 4;
+        hard = ::min(::min(soft * 4, left / 2 + inc_ms), left);
+        soft = ::min(soft, hard);
+    }
+
+    void begin_turn() {
+        turn_start = now_ms();
+    }
+    // Charges the time since begin_turn() to turn, false if its flag fell
+    bool end_turn(UINT turn) {
+        remaining_ms[turn] -= now_ms() - turn_start;
+        if(remaining_ms[turn] < 0)
+            return false;
+        remaining_ms[turn] += inc_ms;
+        if(period_moves && --moves_left[turn] == 0) {
+            remaining_ms[turn] += base_ms;
+            moves_left[turn] = period_moves;
         }
+        return true;
     }
+};
+
+//
+// SEARCH TRACE
+//
+// Optional record of every alpha_beta_minimax() node, appended to a file and read back with
+// "trace". A node is written when it returns, so its children come right before it one ply
+// deeper and a ply 0 record closes one iteration's tree. Records hold the position rather than
+// its hash so the reader can regenerate the moves and name the ones a cutoff skipped.
+//
+// File: TRACE_MAGIC, then 28 byte records: WP, BP, K, alpha, beta, score as little-endian
+// 32 bit words, then ply, depth, flags and a zero byte
+//
+#define TRACE_MAGIC "CKTRACE1"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_RECORD_SIZE 28
+#define TRACE_BUFFER_RECORDS 8192
+#define TRACE_BLACK 1
+#define TRACE_CUTOFF 2
+#define TRACE_FAIL_LOW 4
+
+class SearchTracer {
+    FILE *out;
+    unsigned char buf[TRACE_BUFFER_RECORDS * TRACE_RECORD_SIZE];
+    size_t used;
 
+public:
+    SearchTracer() {
+        out = NULL;
+        used = 0;
+    }
+    ~SearchTracer() {
+        close();
+    }
 
-    //
-    // GET_MOVES() - calls on the other 'get' functions to get all legal moves
-    // returns false if there are no moves left
-    //
-    bool get_moves(UINT turn, UINT WP, UINT BP, UINT K, UINT &end,vector<Move> &moves) {
-        moves.clear();
-        UINT walker_num, walkers;
-        UINT jumper_num, jumpers;
-
-        if(turn == WHITE) {
-            jumpers = get_jumpers_W(WP,BP,K);
-            while(jumpers) { 
-                jumper_num = get_lsb(jumpers);
-                jumpers ^= S[jumper_num];
-                get_jumps_W(jumper_num,WP,BP,K,WP,BP,K,jumper_num,end,moves);
-                if(!jumpers)
-                    return true;
-            }
-            walkers = get_walkers_W(WP,BP,K);
-            while(walkers) {
-                walker_num = get_lsb(walkers);
-                walkers ^= S[walker_num];
-                get_walks_W(walker_num,WP,BP,K,moves);
-                if(!walkers)
-                    return true;
-            }
-        }
-
-        else if(turn == BLACK) {
-            jumpers = get_jumpers_B(WP,BP,K);
-            while(jumpers) {
-                jumper_num = get_lsb(jumpers);
-                jumpers ^= S[jumper_num];
-                get_jumps_B(jumper_num,WP,BP,K,WP,BP,K,jumper_num,end,moves);
-                if(!jumpers)
-                    return true;
-            }
-            walkers = get_walkers_B(WP,BP,K);
-            while(walkers) {
-                walker_num = get_lsb(walkers);
-                walkers ^= S[walker_num];
-                get_walks_B(walker_num,WP,BP,K,moves);
-                if(!walkers)
-                    return true;
-            }
+    // Appends to path, writing the magic first if the file is new
+    bool open(const string &path) {
+        close();
+        out = fopen(path.c_str(), "ab");
+        if(!out)
+            return false;
+        fseek(out, 0, SEEK_END);
+        if(ftell(out) == 0)
+            fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, out);
+        return true;
+    }
+    void close() {
+        if(out) {
+            flush();
+            fclose(out);
+            out = NULL;
         }
+    }
+    void flush() {
+        fwrite(buf, 1, used, out);
+        fflush(out);
+        used = 0;
+    }
 
-        return false;
+    // min and max are the window the node was searched with. A cutoff reached the far bound
+    // for the side to move, a fail low never got past the near one.
+    void record(UINT WP, UINT BP, UINT K, bool is_max_node, int ply, int depth, int min, int max, int score) {
+        unsigned char *rec = buf + used;
+        write_le32(rec, WP);
+        write_le32(rec + 4, BP);
+        write_le32(rec + 8, K);
+        write_le32(rec + 12, min);
+        write_le32(rec + 16, max);
+        write_le32(rec + 20, score);
+        rec[24] = ply;
+        rec[25] = depth;
+        rec[26] = is_max_node ? 0 : TRACE_BLACK;
+        if(is_max_node ? score >= max : score <= min)
+            rec[26] |= TRACE_CUTOFF;
+        else if(is_max_node ? score <= min : score >= max)
+            rec[26] |= TRACE_FAIL_LOW;
+        rec[27] = 0;
+        used += TRACE_RECORD_SIZE;
+        if(used == sizeof(buf))
+            flush();
     }
+};
 
+class Game {
 
-    //
-    // MAKING MOVES FOR PLAYER/COMPUTER
-    //
-    bool player_move(UINT start, UINT end) {
-        Move move, this_move = Move(start,end);
-        vector<Move>::iterator itr;
-        for(itr = m_moves.begin(); itr != m_moves.end(); itr++) {
-            move = *itr;
-            if(move == this_move) {
-                UINT WP_old = m_WP;
-                UINT BP_old = m_BP;
-                UINT K_old = m_K;
-                m_WP ^= move.WM;
-                m_BP ^= move.BM;
-                m_K ^= move.KM;
+    // Masks for moving pieces, top/bottom row for promotions, and special positions on board
+    UINT MASK_L3, MASK_L4, MASK_L5, MASK_R3, MASK_R4, MASK_R5;
+    UINT MASK_TOP, MASK_BOT;
+    UINT MASK_EDGES;
+    UINT MASK_DBLCORNER1, MASK_DBLCORNER2;
 
-                cout << endl;
-                cout << "You moved from " << bitnum_to_coord(start) << " to " << bitnum_to_coord(end) << "." << endl;
-                if((S[start] & (WP_old | BP_old) & (~K_old)) && (S[end] & m_K)) {
-                    if(m_turn == WHITE)
-                        cout << "White piece at " << bitnum_to_coord(end) << " has been promoted to a King!" << endl; 
-                    else if(m_turn == BLACK)
-                        cout << "Black piece at " << bitnum_to_coord(end) << " has been promoted to a King!" << endl;
-                }
+    // The same masks in the padded layout, plus each side's starting twelve squares
+    UINT64 PMASK_TOP, PMASK_BOT, PMASK_EDGES, PMASK_DBLCORNERS, PMASK_B_SIDE, PMASK_W_SIDE;
+    
+    // Look-up tables for 16 bit numbers, shared by every Game instance
+    static unsigned char bitCount_Tbl[65536];
+    static unsigned char msb_Tbl[65536];
+    static unsigned char lsb_Tbl[65536];
+    static once_flag tables_ready;
 
-                cout << endl;
-                return true;
-            }
-        }
-        cout << "Illegal Move!, please check the legal moves list and try again." << endl;
-        cout << endl;
-        return false;
-    }
-    void computer_move(bool is_max_node) {
-        signal(SIGALRM, signalHandler);
+public:
+    // Move class for holding information about a single move
+    struct Move {
 
-        cpu_time_up = false;
-        is_leaf_node = false;
-        best_move = best_move_temp = Move(0,0,0,0,0);
+        // Start and end square numbers
+        UINT start, end;
 
-        // return if there are no more moves
-        if(m_moves.size() == 0)
-            return;
+        // Bitboards of the locations that change
+        // XOR these with the current board to get next board
+        UINT WM, BM, KM;
 
-        // If there is only one move, take it
-        else if(m_moves.size() == 1) {
-            cpu_maxdepth = 1;
-            best_move = m_moves.back();
-        }
+        Move() {}
 
-        // If there are more than one move, search for best move
-        else {
-            alarm(cpu_timelimit);
-            itr_deepening(is_max_node,1,INFTY_P);
-            if(best_move == Move(0,0,0,0,0))
-                best_move = m_moves.at(rand() % m_moves.size());
+        Move(UINT start, UINT end) {
+            this->start = start;
+            this->end = end;
         }
 
-        cpu_time_up = false;
-        is_leaf_node = false;
-
-        // Update board the selected move
-        UINT WP_old = m_WP;
-        UINT BP_old = m_BP;
-        UINT K_old = m_K;
-        m_WP ^= best_move.WM;
-        m_BP ^= best_move.BM;
-        m_K ^= best_move.KM;
-
-        cout << endl;
-        cout << "Computer moved from " << bitnum_to_coord(best_move.start) << " to " << bitnum_to_coord(best_move.end) << "." << endl;
-
-        // If start piece is regular && end piece is a king
-        if((S[best_move.start] & (WP_old | BP_old) & (~K_old)) && (S[best_move.end] & m_K)) {
-            if(m_turn == WHITE) {
-                cout << "White piece at " << bitnum_to_coord(best_move.end) << " has been promoted to a King!" << endl;
-            }
-            else if(m_turn == BLACK) {
-                cout << "Black piece at " << bitnum_to_coord(best_move.end) << " has been promoted to a King!" << endl;
-            }
+        Move(UINT start, UINT end, UINT WM, UINT BM, UINT KM) {
+            this->start = start;
+            this->end = end;
+            this->WM = WM;
+            this->BM = BM;
+            this->KM = KM;
         }
+        
+        bool operator==(const Move &other) {
+            return (start == other.start) ? (end == other.end) : false;
+        }
+    };
 
-        cout << endl;
-        return;
-    }
-
-
-    //
-    // MINIMAX W/ ALPHA-BETA PRUNING
-    // ITERATIVE DEEPENING
-    //
-    int alpha_beta_minimax(bool is_max_node, int depth, int min, int max, UINT WP, UINT BP, UINT K) {
+    // Move on the padded layout, squares are padded bit numbers
+    struct PaddedMove {
+        UINT start, end;
+        UINT64 WM, BM, KM;
+    };
 
-        if(cpu_time_up)
-            return is_max_node ? INFTY_P : INFTY_N;
+    // One completed itr_deepening() iteration, handed to the search_async() callback
+    struct SearchInfo {
+        int depth, score;
+        Move best;
+        UINT64 nodes;
+        long long ms;
+        vector<Move> pv;
+    };
 
-        // depth is 0 or node is leaf, return value
-        if(depth == 0) {
-            int value;
-            value = heuristics(WP,BP,K);
-            return value;
+    // Handle of a search_async() search. cancel() may be called from any thread, the search
+    // checks the token at every node so it returns within one node's work
+    class SearchJob {
+        friend class Game;
+        thread worker;
+        atomic<bool> stop_token;
+        promise<Move> best;
+        shared_future<Move> result;
+
+    public:
+        SearchJob() : stop_token(false) {
+            result = best.get_future().share();
         }
-
-        // Get moves of current player
-        vector<Move> moves;
-        get_moves(is_max_node ? WHITE : BLACK, WP, BP, K, end_temp, moves);
-        is_leaf_node = false;
-        if(moves.empty()) {
-            is_leaf_node = true;
-            return  is_max_node ? INFTY_N + depth : INFTY_P - depth;
+        ~SearchJob() {
+            cancel();
+            if(worker.joinable())
+                worker.join();
         }
+        void cancel() { stop_token = true; }
+        bool done() { return result.wait_for(chrono::seconds(0)) == future_status::ready; }
+        Move wait() { return result.get(); }
+    };
 
-        // Max function
-        if(is_max_node) {
-            for(int i = 0; i < moves.size(); i++) {
-                Move move = moves[i];
-                UINT WP_next = WP ^ move.WM;
-                UINT BP_next = BP ^ move.BM;
-                UINT K_next = K ^ move.KM;
-                int value = alpha_beta_minimax(!is_max_node,depth-1,min,max,WP_next,BP_next,K_next);
-
-                if(value > min) {
-                    min = value;
-                    if(depth == root_depth)
-                        best_move_temp = move;
-                }
+private:
+    //
+    // GAME INFO
+    //
+    int White_Player;
+    int BlacK_Player;
+    UINT m_turn;
+    int m_turn_num;
 
-                if(min >= max)
-                    return max;
-            }
-        }
+    // Bitboards for White, Black, and Kings
+    UINT m_WP, m_BP, m_K;
 
-        // Min function
-        else {
-            for(int i = 0; i < moves.size(); i++) {
-                Move move = moves[i];
-                UINT WP_next = WP ^ move.WM;
-                UINT BP_next = BP ^ move.BM;
-                UINT K_next = K ^ move.KM;
-                int value = alpha_beta_minimax(!is_max_node,depth-1,min,max,WP_next,BP_next,K_next);
+    // Variable used for updating end position for multiple jumps in single turn
+    UINT end_temp;
 
-                if(value < max) {
-                    max = value;
-                    if(depth == root_depth)
-                        best_move_temp = move;
-                }
+    Move best_move, best_move_temp;
+    vector<Move> m_moves;
 
-                if(max <= min)
-                    return min;
-            }
-        }
+    // Record of the current game, written out as PDN when it ends
+    string m_pdn_path;
+    string m_start_fen;
+    vector<Move> m_game_moves;
 
-        return is_max_node ? min : max;
-    }
-    void itr_deepening(bool is_max_node, int start_depth, int end_depth) {
+    // Hashes of the positions since the last capture or pawn move, the current one last
+    // The game is drawn after m_draw_moves moves by each side without one (0 = no limit)
+    vector<UINT64> m_history;
+    int m_draw_moves;
+    string m_draw_reason;
 
-        // Begin search
-        // cout << "MiniMax Iterative deepening in progress..." << endl;
-        int depth;
-        for(depth = start_depth; depth <= end_depth; depth++) {
-            root_depth = depth;
-            alpha_beta_minimax(is_max_node,depth,INFTY_N,INFTY_P,m_WP,m_BP,m_K);
+    // Clocks of both sides when playing with a time control, m_time_loser is the side whose flag fell (-1 = none)
+    GameClock m_clock;
+    int m_time_loser;
 
-            if(cpu_time_up) {
-                // cout << "CPU time limit for searching was reached." << endl;
-                break;
-            }
-            else {
-                best_move = best_move_temp;
-                cpu_maxdepth = depth;
-            }
+    // Search path hashes on top of m_history, positions below m_rep_floor can't repeat
+    vector<UINT64> m_rep_stack;
+    int m_rep_floor;
 
-            if(is_leaf_node)
-                break;
-        }
-    }
-    
+    // Draws is_search_draw() has found, a node whose count moved while it was searched has a
+    // score that depends on the path to it and is kept out of trans_table
+    UINT64 m_search_draws;
 
     //
-    // HEURISTICS FUNCTION
+    // SEARCH LIMITS AND STATS
     //
-    int heuristics(UINT WP, UINT BP, UINT K) {
-        if(!WP) return INFTY_N;
-        if(!BP) return INFTY_P;
-        int return_value = 0;
-        int offset = 1e4;
-        UINT WPawns = WP&(~K), WK = WP&K;
-        UINT BPawns = BP&(~K), BK = BP&K;
+    // m_deadline (0 = none) is polled from the search as an alternative to the alarm() signal
+    // m_soft_deadline (0 = none) is only checked between iterations, see within_soft_target()
+    long long m_deadline;
+    long long m_soft_deadline, m_search_start;
+
+    // m_node_limit (0 = none) ends the search after that many nodes, whatever the machine's speed
+    UINT64 m_node_limit;
+    atomic<bool> m_stop;
+    UINT64 m_nodes;
+    UINT64 m_tt_probes, m_tt_hits;
+
+    // Set while search_async() runs: the job's stop token and the per-iteration callback
+    const atomic<bool> *m_stop_token;
+    function<void(const SearchInfo &)> m_on_iteration;
+
+    // Size of the evaluation cache this game's searches use on their thread, and the
+    // probes and hits of the last search (see EvalCache)
+    size_t m_eval_cache_kb;
+    UINT64 m_eval_probes, m_eval_hits;
+
+    // Random noise added to heuristics(), turned off for reproducible analysis
+    bool m_eval_noise;
+
+    // Set by set_trace(), records every searched node
+    unique_ptr<SearchTracer> m_tracer;
+
+    // Move lists of exchange_reply() by plies left and of quiescence() by ply
+    vector<Move> m_exchange_moves[EXCHANGE_MAX_PLIES + 1];
+    vector<Move> m_qs_moves[QS_MAX_PLIES];
+    vector<Move> m_forced_moves;
+
+    // Children of the depth 1 node being evaluated by evaluate_children()
+    UINT m_batch_WP[BATCH_MAX_MOVES], m_batch_BP[BATCH_MAX_MOVES], m_batch_K[BATCH_MAX_MOVES];
+
+    // Triangular PV table, row ply holds the best line from that ply down
+    // m_root_pv is the line of the last completed iteration, m_show_pv prints one per depth
+    Move m_pv[MAX_PLY][MAX_PLY];
+    int m_pv_length[MAX_PLY];
+    vector<Move> m_root_pv;
+    int m_root_score;
+    bool m_follow_pv, m_show_pv;
 
-        // Number of each piece on board
-        int w_pawn_count = get_bit_count(WPawns);
-        int b_pawn_count = get_bit_count(BPawns);
-        int w_king_count = get_bit_count(WK);
-        int b_king_count = get_bit_count(BK);
-        int white_count = w_pawn_count + 1.5*w_king_count;
-        int black_count = b_pawn_count + 1.5*b_king_count;
+public:
+    Game() {
+        m_deadline = 0;
+        m_soft_deadline = m_search_start = 0;
+        m_node_limit = 0;
+        m_time_loser = -1;
+        m_stop = false;
+        m_stop_token = NULL;
+        m_nodes = 0;
+        m_tt_probes = m_tt_hits = 0;
+        m_pdn_path = "games.pdn";
+        m_eval_noise = true;
+        m_eval_cache_kb = EVAL_CACHE_DEFAULT_KB;
+        m_eval_probes = m_eval_hits = 0;
+        m_root_score = 0;
+        m_follow_pv = m_show_pv = false;
+        m_draw_moves = 40;
+        m_rep_floor = 0;
+        m_search_draws = 0;
+        call_once(tables_ready, init_tables);
 
-        // Pieces on their first row have more weight
-        UINT Wfirst = WPawns & MASK_BOT;
-        UINT Bfirst = BPawns & MASK_TOP;
-             
-        // Get jumpers
-        UINT Wjump = get_jumpers_W(WP,BP,K);
-        UINT Bjump = get_jumpers_B(WP,BP,K);
+        // Numbers representing the bit positions
+        /*
+        Black on top  
+          00  01  02  03 
+        04  05  06  07
+          08  09  10  11
+        12  13  14  15
+          16  17  18  19
+        20  21  22  23  
+          24  25  26  27 
+        28  29  30  31  
+        White on bottom 
+        */
 
-        // Edges are discouraged for kings
-        if(WK & MASK_EDGES) return_value -= offset*10;
-        if(BK & MASK_EDGES) return_value += offset*10;
+        // Mask for pieces MOVING DOWN
+        MASK_L3 = S[ 5] | S[ 6] | S[ 7] | S[13] | S[14] | S[15] | S[21] | S[22] | S[23];
+        MASK_L5 = S[ 0] | S[ 1] | S[ 2] | S[ 8] | S[ 9] | S[10] | S[16] | S[17] | S[18] | S[24] | S[25] | S[26];
 
-        // Loop through each square
-        UINT square;
-        for(UINT i = 0; i < 32; i++) {
-            square = S[i];
+        // Mask for pieces MOVING UP
+        MASK_R3 = S[ 8] | S[ 9] | S[10] | S[16] | S[17] | S[18] | S[24] | S[25] | S[26];
+        MASK_R5 = S[ 5] | S[ 6] | S[ 7] | S[13] | S[14] | S[15] | S[21] | S[22] | S[23] | S[29] | S[30] | S[31];
 
-            // On white-starting side of board
-            if(i > 19) {
-                // Increase score for each white piece on white-starting side
-                if(square & WPawns) return_value += offset*2000;
-                // Increase score for each white piece on its first row
-                if(square & Wfirst) return_value += offset*10;
-                // Decrease score for each black piece on white-starting side
-                if(square & BPawns) return_value -= offset*2010;
-            }
+        // All other possibilties are covered by LS4 (for pieces MOVING DOWN) or RS4 (for pieces MOVING UP)
 
-            // On black-starting side of board
-            else if(i < 12) {
-                if(square & BPawns) return_value -= offset*2000;
-                if(square & Bfirst) return_value -= offset*10;
-                if(square & WPawns) return_value += offset*2010;
-            }
+        // Masks for checking if top or bottom row
+        MASK_TOP = S[ 0] | S[ 1] | S[ 2] | S[ 3];
+        MASK_BOT = S[28] | S[29] | S[30] | S[31];
 
-            // In neutral region, increase score for each piece
-            else {
-                if(square & WPawns) return_value += offset*2000;
-                if(square & BPawns) return_value -= offset*2000;
-            }
+        // Masks for edges of board
+        MASK_EDGES =   S[ 0] | S[ 1] | S[ 2] | S[ 3]
+                     | S[ 4]                 | S[11]
+                     | S[12]                 | S[19]
+                     | S[20]                 | S[27]
+                     | S[28] | S[29] | S[30] | S[31];
 
-            // Points for Kings
-            if(square & WK) return_value += offset*3000;
-            if(square & BK) return_value -= offset*3000;
+        // Masks for corners
+        MASK_DBLCORNER1 = S[ 0] | S[ 4];
+        MASK_DBLCORNER2 = S[27] | S[31];
 
-            // Pieces that can jump
-            if(square & Wjump) return_value += offset*100;
-            if(square & Bjump) return_value -= offset*100;
-        }
+        PMASK_TOP = pad_board(MASK_TOP);
+        PMASK_BOT = pad_board(MASK_BOT);
+        PMASK_EDGES = pad_board(MASK_EDGES);
+        PMASK_DBLCORNERS = pad_board(MASK_DBLCORNER1 | MASK_DBLCORNER2);
+        PMASK_B_SIDE = pad_board(0x00000FFF);
+        PMASK_W_SIDE = pad_board(0xFFF00000);
+    }
 
-        // When both players have less than 6 pieces (pawns count as 1, kings count as 1.5),
-        // Winning player will be more aggressive
-        // Losing player will be more defensive
-        if(white_count < 6 && black_count < 6) {
-            if(white_count > black_count) {
-                // Losing player get more points for double corners
-                if(BP & (MASK_DBLCORNER1 | MASK_DBLCORNER2))
-                    return_value -= offset*100;
+    // Fill S[] and the 16 bit look-up tables, done once per process
+    static void init_tables() {
 
-                // Winning player focused more on capturing
-                return_value -= offset*b_pawn_count*300;
-                return_value -= offset*b_king_count*500;
-            }
+        // Bit masks from 1st to 31st bit
+        S[0] = 1;
+        for(UINT i = 1; i < 32; i++)
+            S[i] = S[i-1] * 2;
 
-            else if(white_count < black_count) {
-                if(WP & (MASK_DBLCORNER1 | MASK_DBLCORNER2))
-                    return_value += offset*100;
-                return_value += offset*w_pawn_count*300;
-                return_value += offset*w_king_count*500;
+        // Initialize look-up tables
+        for(int bb_half = 0; bb_half < 65536; bb_half++) {
+            int bitCount = 0, msb = 255, lsb = 255;
+            for (int i = 0; i < 16; i++) {
+                if (bb_half & S[i]) {
+                    bitCount++;
+                    if (lsb == 255) {
+                        lsb = i;
+                    }
+                    msb = i;
+                }
             }
+            bitCount_Tbl[bb_half] = bitCount;
+            msb_Tbl[bb_half] = msb;
+            lsb_Tbl[bb_half] = lsb;
         }
-
-        // Add a slight randomness to the value
-        return_value += ((rand() % 2001) - 1000);
-        return return_value;
     }
 
 
     //
-    // PRINT FUNCTIONS
+    // LOADING BOARDS
     //
-
-    // helper functions to convert between coordinates and bitnums
-    string bitnum_to_coord(UINT square_num) {
-        int r = square_num / 4;
-        int c = (square_num % 4) * 2;
-        if(r % 2 == 0)
-            c++;
-        int row = r + 1;
-        char col = char(c + 97);
-        stringstream ss;
-        ss << "(" << row << "," << col << ")";
-        return ss.str();
-    }
-    UINT coord_to_bitnum(int row, char col) {
-        int r = row - 1;
-        int c = int(col - 97);
-        if((r % 2 == 0 && c % 2 == 0) || (r % 2 == 1 && c % 2  == 1))
-            return 33;
-        if(r % 2 == 0)
-            c--;
-        c /= 2;
-        return  r * 4 + c;
+    // Initialize board
+    void init_board(UINT &WP, UINT &BP, UINT &K) {
+        WP = 0xFFF00000;
+        BP = 0x00000FFF;
+        K = 0;
     }
+    // Load custom board
+    void cust_board(UINT &WP, UINT &BP, UINT &K, UINT &turn, int &time) {
+        ifstream board_file;
+        string file_name;
 
-    void print_board(UINT WP, UINT BP, UINT K) {
-        cout << "\033[0m"; // return to default color for console
+        while(true) {
+            cout << "Enter file name: ";
+            if(!(cin >> file_name)) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+            else {
+                board_file.open(file_name);
+                if(!board_file)
+                    cerr << "Error: Cannot open file." << endl;
+                else {
+                    cout << endl;
+                    break;
+                }
+            }
+        }
 
-        ios::fmtflags f = cout.flags();
-        cout << "\e[47m"
-             << "\e[1;31m" << "  Black:" << setw(2) << get_bit_count(m_BP)
-             << "\e[1;34m" << "   White:" << setw(2) << get_bit_count(m_WP) << "  "
-             << "\e[0m" << endl
-             << "\e[47m" << "                       " << "\e[0m" << endl;
-        cout.flags(f);
+        // A FEN line followed by the time limit
+        board_file >> ws;
+        if(board_file.peek() == 'W' || board_file.peek() == 'B') {
+            string fen;
+            board_file >> fen;
+            if(!parse_fen(fen.data(),fen.data() + fen.size(),WP,BP,K,turn)) {
+                cerr << "Error: Malformed FEN, loading the starting board." << endl;
+                init_board(WP,BP,K);
+                turn = WHITE;
+            }
+            board_file >> time;
+            return;
+        }
 
-        // Column letters (top)
-        cout << "\e[1;30;47m" << "     a b c d e f g h   " << "\e[0m" << endl
-             << "\e[1;30;47m" << "                       " << "\e[0m" << endl;
+        int row = 0, i = 0, piece;
+        WP = BP = K = 0;
+        while(board_file >> piece) {
+            if(piece == 0) {
+            }
+            else if(piece == 1)
+                WP |= (1 << i);
+            else if(piece == 2)
+                BP |= (1 << i);
+            else if(piece == 3) {
+                WP |= (1 << i);
+                K |= (1 << i);
+            }
+            else {
+                BP |= (1 << i);
+                K |= (1 << i);
+            }
 
-        // i goes through pieces
-        // toggle determines format of empty square
-        // counter determines next line
-        UINT i, toggle = 0, counter = 0, row = 1;
+            i++;
+            if(i % 4 == 0)
+                row++;
 
-        for(i = 0; i < 32; i++) {
+            if(row == 8)
+                break;
+        }
 
-            // ANSI escape sequence format
-            // "\e[n;n;nm"
-            // n represents a trait, bold, color, etc
+        board_file >> turn;
+        turn--;
+        board_file >> time;
+    }
 
-            if(counter == 0)
-                cout << "\e[47m" << "\e[1;30m" << row << "   " << "|";
 
-            if(toggle == 0)
-                cout << "\e[47m" << " " << "\e[1;30m" << "|";
+    //
+    // HELPER FUNCTIONS FOR BIT OPERATIONS
+    //
+    UINT get_bit_count(UINT i) {
+        if (i == 0)
+            return 0;
+        return bitCount_Tbl[i & 65535] + bitCount_Tbl[(i >> 16) & 65535];
+    }
+    UINT get_lsb(UINT i) {
+        if(i & 65535)
+            return lsb_Tbl[i & 65535];
+        if((i >> 16) & 65535)
+            return lsb_Tbl[(i >> 16) & 65535] + 16;
+        return 0;
+    }
+    UINT get_msb(UINT i) {
+        if((i >> 16) & 65535)
+            return msb_Tbl[(i >> 16) & 65535] + 16;
+        if(i & 65535)
+            return msb_Tbl[i & 65535];
+        return 0;
+    }
 
-            if(WP & ~K & (1 << i))
-                cout << "\e[0m" << "\e[34;47m" << "w" << "\e[1;30m" << "|";
-            else if(WP & K & (1 << i))
-                cout << "\e[0m" << "\e[1;34;47m" << "W" << "\e[1;30m" << "|";
-            else if(BP & ~K & (1 << i))
-                cout << "\e[0m" << "\e[31;47m" << "b" << "\e[1;30m" << "|";
-            else if(BP & K & (1 << i))
-                cout << "\e[0m" << "\e[1;31;47m" << "B" << "\e[1;30m" << "|";
-            else
-                cout << "\e[47m" << " " << "\e[1;30m" <<  "|";
 
+    //
+    // GET PIECES THAT CAN MOVE, WALK/JUMP
+    //
+    UINT get_walkers_W(UINT WP, UINT BP, UINT K) {
+        const UINT UOCC = ~(WP|BP);
+        const UINT WK = WP&K;
+        UINT walkers = ((UOCC << 4) & WP) | (((UOCC & MASK_L3) << 3) & WP) | (((UOCC & MASK_L5) << 5) & WP);
+        if(WK) 
+            walkers |= ((UOCC >> 4) & WK) | (((UOCC & MASK_R3) >> 3) & WK) | (((UOCC & MASK_R5) >> 5) & WK);
+        return walkers;
+    }
+    UINT get_walkers_B(UINT WP, UINT BP, UINT K) {
+        const UINT UOCC = ~(WP|BP);
+        const UINT BK = BP&K;
+        UINT walkers = ((UOCC >> 4) & BP) | (((UOCC & MASK_R3) >> 3) & BP) | (((UOCC & MASK_R5) >> 5) & BP);
+        if(BK)
+            walkers |= ((UOCC << 4) & BK) | (((UOCC & MASK_L3) << 3) & BK) | (((UOCC & MASK_L5) << 5) & BK);
+        return walkers;
+    }
+    UINT get_jumpers_W(UINT WP, UINT BP, UINT K) {
+        const UINT UOCC = ~(WP|BP);
+        const UINT WK = WP&K;
+        UINT jumpers = 0;
 
-            if(toggle == 1)
-                cout << "\e[47m" << " " << "\e[1;30m" << "|";
+        // Check empty against opponent piece, then check against own piece
+        UINT temp = (UOCC << 4) & BP;
+        if(temp)
+            jumpers |= (((temp & MASK_L3) << 3) | ((temp & MASK_L5) << 5)) & WP;
+        
+        temp = (((UOCC & MASK_L3) << 3) | ((UOCC & MASK_L5) << 5)) & BP;
+        if(temp)
+            jumpers |= (temp << 4) & WP;
 
+        if(WK) {
+            temp = (UOCC >> 4) & BP;
+            if(temp)
+                jumpers |= (((temp & MASK_R3) >> 3) | ((temp & MASK_R5) >> 5)) & WK;
 
-            // Newline after 4 pieces
-            counter = (counter + 1) % 4;
-            if(counter == 0) {
-                toggle ^= 1;
-                cout << "\e[47m" << "  " << "\e[0m" << endl;
-                row++;
-            }
+            temp = (((UOCC & MASK_R3) >> 3) | ((UOCC & MASK_R5) >> 5)) & BP;
+            if(temp)
+                jumpers |= (temp >> 4) & WK;
         }
+
+        return jumpers;
     }
+    UINT get_jumpers_B(UINT WP, UINT BP, UINT K) {
+        const UINT UOCC = ~(WP|BP);
+        const UINT BK = BP&K;
+        UINT jumpers = 0;
 
-    void print_legal_moves(vector<Move> moves) {
-        cout << "Legal moves: " << endl;
+        UINT temp = (UOCC >> 4) & WP;
+        if(temp)
+            jumpers |= (((temp & MASK_R3) >> 3) | ((temp & MASK_R5) >> 5)) & BP;
+        
+        temp = (((UOCC & MASK_R3) >> 3) | ((UOCC & MASK_R5) >> 5)) & WP;
+        if(temp)
+            jumpers |= (temp >> 4) & BP;
+        
+        if(BK) {
+            temp = (UOCC << 4) & WP;
+            if(temp)
+                jumpers |= (((temp & MASK_L3) << 3) | ((temp & MASK_L5) << 5)) & BK;
 
-        UINT start, end;
-        Move move;
-        vector<Move>::iterator itr;
-        for(itr = moves.begin(); itr != moves.end(); ++itr) {
-            move = *itr;
-            start = move.start;
-            end = move.end;
-            cout << bitnum_to_coord(start) << " => " << bitnum_to_coord(end) << endl;
+            temp = (((UOCC & MASK_L3) << 3) | ((UOCC & MASK_L5) << 5)) & WP;
+            if(temp)
+                jumpers |= (temp << 4) & BK;
         }
+
+        return jumpers;
     }
 
-    void print_turn_info(UINT turn, int turn_num) {
-        cout << "Turn " << turn_num << ": ";
+    //
+    // PADDED BOARD MOVES
+    //
+    // Same moves as the 32 square tables gave, generated with the constant shifts of the
+    // padded layout (see pad_board()). Directions are tried Up-Left, Up-Right, Down-Left,
+    // Down-Right for White and Down-Left, Down-Right, Up-Left, Up-Right for Black, kings
+    // taking all four, so lists come out in the order the search and the protocol rely on.
+    static UINT64 padded_step(UINT64 b, int step) {
+        return step > 0 ? b << step : b >> -step;
+    }
+    UINT64 padded_walkers(UINT turn, UINT64 WP, UINT64 BP, UINT64 K) {
+        const UINT64 empty = ~(WP|BP) & PAD_SQUARES;
+        const UINT64 up = (empty << 4) | (empty << 5), down = (empty >> 4) | (empty >> 5);
         if(turn == WHITE)
-            cout << "White's turn." << endl;
-        else if(turn == BLACK)
-            cout << "Black's turn." << endl;
+            return (WP & up) | (WP & K & down);
+        return (BP & down) | (BP & K & up);
+    }
+    UINT64 padded_jumpers(UINT turn, UINT64 WP, UINT64 BP, UINT64 K) {
+        const UINT64 empty = ~(WP|BP) & PAD_SQUARES;
+        const UINT64 opp = turn == WHITE ? BP : WP;
+        const UINT64 up = ((opp << 4) & (empty << 8)) | ((opp << 5) & (empty << 10));
+        const UINT64 down = ((opp >> 4) & (empty >> 8)) | ((opp >> 5) & (empty >> 10));
+        if(turn == WHITE)
+            return (WP & up) | (WP & K & down);
+        return (BP & down) | (BP & K & up);
+    }
+    // Walks of a board without captures, counted from the destination sets
+    UINT64 padded_walk_count(UINT turn, UINT64 WP, UINT64 BP, UINT64 K) {
+        const UINT64 empty = ~(WP|BP) & PAD_SQUARES;
+        UINT64 forward = turn == WHITE ? WP : BP, kings = forward & K;
+        if(turn == WHITE)
+            return __builtin_popcountll((forward >> 4) & empty) + __builtin_popcountll((forward >> 5) & empty)
+                 + __builtin_popcountll((kings << 4) & empty) + __builtin_popcountll((kings << 5) & empty);
+        return __builtin_popcountll((forward << 4) & empty) + __builtin_popcountll((forward << 5) & empty)
+             + __builtin_popcountll((kings >> 4) & empty) + __builtin_popcountll((kings >> 5) & empty);
     }
 
-    void print_winner(UINT WP, UINT BP) {
-        cout << "No more possible moves left. The game is over!" << endl;
-        if(get_bit_count(WP) > get_bit_count(BP))
-            cout << "WHITE WINS!" << endl;
-        else if(get_bit_count(WP) < get_bit_count(BP))
-            cout << "BLACK WINS!" << endl;
-        else if(get_bit_count(WP) == 1 && get_bit_count(BP) == 1)
-            cout << "Both sides only have one piece left. DRAW!" << endl;
-        else
-            cout << "DRAW!" << endl;
+    // Moves are listed as PaddedMove, or straight away as the 32 square Move for get_moves()
+    static void add_move(vector<PaddedMove> &moves, UINT start, UINT end, UINT64 WM, UINT64 BM, UINT64 KM) {
+        moves.push_back({ start, end, WM, BM, KM });
+    }
+    static void add_move(vector<Move> &moves, UINT start, UINT end, UINT64 WM, UINT64 BM, UINT64 KM) {
+        moves.push_back(Move(unpad_square(start),unpad_square(end),unpad_board(WM),unpad_board(BM),unpad_board(KM)));
+    }
+    static bool has_move(const vector<PaddedMove> &moves, UINT start, UINT end) {
+        for(size_t i = 0; i < moves.size(); i++)
+            if(moves[i].start == start && moves[i].end == end)
+                return true;
+        return false;
+    }
+    static bool has_move(const vector<Move> &moves, UINT start, UINT end) {
+        start = unpad_square(start);
+        end = unpad_square(end);
+        for(size_t i = 0; i < moves.size(); i++)
+            if(moves[i].start == start && moves[i].end == end)
+                return true;
+        return false;
     }
 
-    void print_cpu_stats() {
-        streamsize ss = cout.precision();
-        cout << "CPU search time: " << fixed << setprecision(3) << cpu_time << endl;
-        cout.precision(ss);
-        cout << "Max depth searched: " << cpu_maxdepth << endl;
+    template<class MoveList>
+    void padded_walks(UINT turn, UINT sq, UINT64 WP, UINT64 BP, UINT64 K, MoveList &moves) {
+        static const int steps[2][4] = { { -5, -4, 4, 5 }, { 4, 5, -5, -4 } };
+        const UINT64 empty = ~(WP|BP) & PAD_SQUARES;
+        UINT64 bb = 1ULL << sq;
+        bool king = bb & K;
+        for(int d = 0; d < (king ? 4 : 2); d++) {
+            UINT64 next = padded_step(bb,steps[turn][d]) & empty;
+            if(!next)
+                continue;
+            UINT64 PM = bb | next;
+            UINT64 KM = king ? PM : next & (turn == WHITE ? PMASK_TOP : PMASK_BOT);
+            add_move(moves,sq,sq + steps[turn][d],turn == WHITE ? PM : 0,turn == WHITE ? 0 : PM,KM);
+        }
+    }
+    // Jump sequences of the piece on sq, depth first. A sequence is listed when it can go no
+    // further or the pawn is crowned, once per start and end square. end is left at the last
+    // landing square tried. Returns whether sq had a jump.
+    template<class MoveList>
+    bool padded_jumps(UINT turn, UINT sq, UINT64 WP, UINT64 BP, UINT64 K, UINT64 WP_orig, UINT64 BP_orig, UINT64 K_orig, UINT start, UINT &end, MoveList &moves) {
+        static const int steps[2][4] = { { -5, -4, 4, 5 }, { 4, 5, -5, -4 } };
+        const UINT64 empty = ~(WP|BP) & PAD_SQUARES;
+        const UINT64 opp = turn == WHITE ? BP : WP;
+        UINT64 bb = 1ULL << sq;
+        bool king = bb & K, jumped = false;
+        for(int d = 0; d < (king ? 4 : 2); d++) {
+            UINT64 over = padded_step(bb,steps[turn][d]) & opp;
+            UINT64 land = padded_step(over,steps[turn][d]) & empty;
+            if(!land)
+                continue;
+            jumped = true;
+            UINT landing = end = sq + 2 * steps[turn][d];
+            UINT64 PM = bb | land;
+            UINT64 KM = (over & K) | (king ? PM : 0);
+            bool crowned = !king && (land & (turn == WHITE ? PMASK_TOP : PMASK_BOT));
+            if(crowned)
+                KM |= land;
+            UINT64 WP_next = WP ^ (turn == WHITE ? PM : over), BP_next = BP ^ (turn == WHITE ? over : PM), K_next = K ^ KM;
+            if(!crowned && padded_jumps(turn,landing,WP_next,BP_next,K_next,WP_orig,BP_orig,K_orig,start,end,moves))
+                continue;
+            if(!has_move(moves,start,landing))
+                add_move(moves,start,landing,WP_orig ^ WP_next,BP_orig ^ BP_next,K_orig ^ K_next);
+        }
+        return jumped;
+    }
+    // Legal moves of turn on a padded board, captures being compulsory
+    template<class MoveList>
+    bool get_padded_moves(UINT turn, UINT64 WP, UINT64 BP, UINT64 K, UINT &end, MoveList &moves) {
+        moves.clear();
+        UINT64 jumpers = padded_jumpers(turn,WP,BP,K);
+        if(jumpers) {
+            for(; jumpers; jumpers &= jumpers - 1) {
+                UINT sq = __builtin_ctzll(jumpers);
+                padded_jumps(turn,sq,WP,BP,K,WP,BP,K,sq,end,moves);
+            }
+            return true;
+        }
+        for(UINT64 walkers = padded_walkers(turn,WP,BP,K); walkers; walkers &= walkers - 1)
+            padded_walks(turn,__builtin_ctzll(walkers),WP,BP,K,moves);
+        return !moves.empty();
     }
 
 
     //
-    // SETUP_PARAMETERS() AND PLAY()
+    // GET_MOVES() - all legal moves of the 32 square board, returns false if there are none
+    // end is left at the last landing square of a capture, if there were any
     //
-    void setup_parameters() {
-        cpu_time = 0;
-        cpu_timelimit = 0;
-        cpu_maxdepth = 0;
-        root_depth=  0;
-        cpu_time_up = false;
-        m_WP = 0;
-        m_BP = 0;
-        m_K = 0;
-        end_temp = 0;
-        best_move = best_move_temp = Move(0,0,0,0,0);
-        m_moves.clear();
-        m_turn = 0;
-        m_turn_num = 1;
+    bool get_moves(UINT turn, UINT WP, UINT BP, UINT K, UINT &end, vector<Move> &moves) {
+        UINT end_padded = 99;
+        get_padded_moves(turn,pad_board(WP),pad_board(BP),pad_board(K),end_padded,moves);
+        if(end_padded != 99)
+            end = unpad_square(end_padded);
+        return !moves.empty();
     }
 
-    int play() {
-        // player inputs and game states
-        int row1, row2;
+
+    //
+    // MAKING MOVES FOR PLAYER/COMPUTER
+    //
+    bool player_move(UINT start, UINT end) {
+        Move move, this_move = Move(start,end);
+        vector<Move>::iterator itr;
+        for(itr = m_moves.begin(); itr != m_moves.end(); itr++) {
+            move = *itr;
+            if(move == this_move) {
+                UINT WP_old = m_WP;
+                UINT BP_old = m_BP;
+                UINT K_old = m_K;
+                m_WP ^= move.WM;
+                m_BP ^= move.BM;
+                m_K ^= move.KM;
+                m_game_moves.push_back(move);
+
+                cout << endl;
+                cout << "You moved from " << bitnum_to_coord(start) << " to " << bitnum_to_coord(end) << "." << endl;
+                if((S[start] & (WP_old | BP_old) & (~K_old)) && (S[end] & m_K)) {
+                    if(m_turn == WHITE)
+                        cout << "White piece at " << bitnum_to_coord(end) << " has been promoted to a King!" << endl; 
+                    else if(m_turn == BLACK)
+                        cout << "Black piece at " << bitnum_to_coord(end) << " has been promoted to a King!" << endl;
+                }
+
+                cout << endl;
+                return true;
+            }
+        }
+        cout << "Illegal Move!, please check the legal moves list and try again." << endl;
+        cout << endl;
+        return false;
+    }
+    void computer_move(bool is_max_node) {
+        signal(SIGALRM, signalHandler);
+
+        // return if there are no more moves
+        if(m_moves.size() == 0)
+            return;
+
+        cpu_time_up = false;
+        if(m_clock.enabled())
+            start_clock_search();
+        else if(m_moves.size() > 1)
+            alarm(cpu_timelimit);
+        choose_move(is_max_node);
+
+        cpu_time_up = false;
+        m_deadline = m_soft_deadline = 0;
+
+        // Update board the selected move
+        UINT WP_old = m_WP;
+        UINT BP_old = m_BP;
+        UINT K_old = m_K;
+        m_WP ^= best_move.WM;
+        m_BP ^= best_move.BM;
+        m_K ^= best_move.KM;
+        m_game_moves.push_back(best_move);
+
+        cout << endl;
+        cout << "Computer moved from " << bitnum_to_coord(best_move.start) << " to " << bitnum_to_coord(best_move.end) << "." << endl;
+
+        // If start piece is regular && end piece is a king
+        if((S[best_move.start] & (WP_old | BP_old) & (~K_old)) && (S[best_move.end] & m_K)) {
+            if(m_turn == WHITE) {
+                cout << "White piece at " << bitnum_to_coord(best_move.end) << " has been promoted to a King!" << endl;
+            }
+            else if(m_turn == BLACK) {
+                cout << "Black piece at " << bitnum_to_coord(best_move.end) << " has been promoted to a King!" << endl;
+            }
+        }
+
+        cout << endl;
+        return;
+    }
+
+
+    // Sets best_move for the side to move
+    // The search runs until cpu_time_up is raised, m_stop is set or m_deadline passes
+    void choose_move(bool is_max_node, int max_depth = INFTY_P) {
+        is_leaf_node = false;
+        best_move = best_move_temp = Move(0,0,0,0,0);
+        cpu_maxdepth = 0;
+        m_root_score = 0;
+        m_stop = false;
+        m_nodes = 0;
+        m_tt_probes = m_tt_hits = 0;
+        m_eval_probes = m_eval_hits = 0;
+        use_eval_cache();
+        m_root_pv.clear();
+
+        // return if there are no more moves
+        if(m_moves.size() == 0)
+            return;
+
+        // If there is only one move, take it
+        else if(m_moves.size() == 1) {
+            cpu_maxdepth = 1;
+            best_move = m_moves.back();
+            m_root_pv.assign(1,best_move);
+        }
+
+        // If there are more than one move, search for best move
+        else {
+            if(!trans_table.is_allocated())
+                trans_table.resize(TT_DEFAULT_MB);
+            trans_table.new_search();
+            init_search_path();
+            itr_deepening(is_max_node,1,max_depth);
+            if(best_move == Move(0,0,0,0,0))
+                best_move = m_moves.at(rand() % m_moves.size());
+        }
+
+        is_leaf_node = false;
+    }
+
+    // Best move of the current position within max_depth and the node limit, without alarm() or the clock
+    Move search_position(int max_depth) {
+        get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves);
+        choose_move(m_turn == WHITE,max_depth);
+        return best_move;
+    }
+    // Non-interactive counterpart of computer_move(), searches until the deadline and plays the move
+    // Returns false if the side to move has no moves
+    bool timed_move(long long deadline, UINT &start, UINT &end) {
+        if(!get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves))
+            return false;
+
+        m_deadline = deadline;
+        choose_move(m_turn == WHITE);
+        m_deadline = 0;
+
+        m_WP ^= best_move.WM;
+        m_BP ^= best_move.BM;
+        m_K ^= best_move.KM;
+        start = best_move.start;
+        end = best_move.end;
+        m_turn ^= 1;
+        m_turn_num++;
+        push_history(best_move);
+        return true;
+    }
+
+    // Polled at every node, the clock is only read every 1024 nodes
+    bool search_time_up() {
+        if(cpu_time_up || m_stop || (m_stop_token && m_stop_token->load(memory_order_relaxed)))
+            return true;
+        if(m_deadline && (m_nodes & 1023) == 0 && now_ms() >= m_deadline)
+            m_stop = true;
+        if(m_node_limit && m_nodes >= m_node_limit)
+            m_stop = true;
+        return m_stop;
+    }
+
+
+    //
+    // REPETITIONS AND THE NO-PROGRESS RULE
+    //
+    // A capture or a pawn move can never be undone, so only positions since the last one can repeat
+    bool is_irreversible(const Move &move) {
+        return (move.WM && move.BM) || !(move.KM & S[move.start]);
+    }
+
+    void set_draw_moves(int moves) {
+        m_draw_moves = moves;
+    }
+
+    void reset_history() {
+        m_history.clear();
+        m_history.push_back(hash_position(m_WP,m_BP,m_K,m_turn));
+        m_draw_reason.clear();
+        m_time_loser = -1;
+    }
+
+    // Called after move has been played and m_turn passed to the other side
+    void push_history(const Move &move) {
+        if(is_irreversible(move))
+            m_history.clear();
+        m_history.push_back(hash_position(m_WP,m_BP,m_K,m_turn));
+    }
+
+    // Threefold repetition or m_draw_moves moves each without a capture or pawn move
+    bool is_draw_by_rule() {
+        m_draw_reason.clear();
+        if(m_draw_moves > 0 && m_history.size() > (size_t)(2 * m_draw_moves)) {
+            stringstream ss;
+            ss << m_draw_moves << " moves each without a capture or pawn move";
+            m_draw_reason = ss.str();
+            return true;
+        }
+        if(count(m_history.begin(),m_history.end(),m_history.back()) >= 3) {
+            m_draw_reason = "threefold repetition";
+            return true;
+        }
+        return false;
+    }
+
+    // Any repetition counts inside the search, it is enough to prove the line goes nowhere
+    bool is_search_draw(UINT64 key) {
+        int count = m_rep_stack.size();
+        if(m_draw_moves > 0 && count - m_rep_floor >= 2 * m_draw_moves) {
+            m_search_draws++;
+            return true;
+        }
+        for(int i = count - 2; i >= m_rep_floor; i -= 2)
+            if(m_rep_stack[i] == key) {
+                m_search_draws++;
+                return true;
+            }
+        return false;
+    }
+
+    // Seed the search path with the game so far, without the root which pushes itself
+    void init_search_path() {
+        m_rep_stack.assign(m_history.begin(),m_history.end() - (m_history.empty() ? 0 : 1));
+        m_rep_floor = 0;
+        m_search_draws = 0;
+    }
+
+    // Returns the old floor for pop_search_path()
+    int push_search_path(UINT64 key, const Move &move) {
+        int floor = m_rep_floor;
+        m_rep_stack.push_back(key);
+        if(is_irreversible(move))
+            m_rep_floor = m_rep_stack.size();
+        return floor;
+    }
+    void pop_search_path(int floor) {
+        m_rep_stack.pop_back();
+        m_rep_floor = floor;
+    }
+
+
+    //
+    // MINIMAX W/ ALPHA-BETA PRUNING
+    // ITERATIVE DEEPENING
+    //
+    //
+    // PRINCIPAL VARIATION
+    //
+    // A new best move at ply takes over the line of the child that produced it
+    void update_pv(int ply, const Move &move) {
+        if(ply >= MAX_PLY)
+            return;
+        m_pv[ply][ply] = move;
+        int length = ply + 1;
+        if(ply + 1 < MAX_PLY) {
+            for(int i = ply + 1; i < m_pv_length[ply+1]; i++)
+                m_pv[ply][i] = m_pv[ply+1][i];
+            length = max(length, m_pv_length[ply+1]);
+        }
+        m_pv_length[ply] = length;
+    }
+    // While the search is still on the last iteration's line, its move at ply is tried first
+    void order_pv_move(int ply, vector<Move> &moves) {
+        m_follow_pv = false;
+        if(ply >= (int)m_root_pv.size())
+            return;
+        for(size_t i = 0; i < moves.size(); i++) {
+            if(moves[i] == m_root_pv[ply]) {
+                swap(moves[0],moves[i]);
+                m_follow_pv = true;
+                return;
+            }
+        }
+    }
+    string pv_string() {
+        string line;
+        for(size_t i = 0; i < m_root_pv.size(); i++)
+            line += (i ? " " : "") + move_to_pdn(m_root_pv[i]);
+        return line;
+    }
+
+    // Leaf values of every child of a depth 1 node, what alpha_beta_minimax() would return for each
+    void evaluate_children(bool is_max_node, UINT64 key, UINT WP, UINT BP, UINT K, const vector<Move> &moves, int *values) {
+        int n = moves.size();
+        UINT *WP_next = m_batch_WP, *BP_next = m_batch_BP, *K_next = m_batch_K;
+        UINT WP_leaf[BATCH_MAX_MOVES] = {}, BP_leaf[BATCH_MAX_MOVES] = {}, K_leaf[BATCH_MAX_MOVES] = {}, turn_leaf[BATCH_MAX_MOVES];
+        int qply_leaf[BATCH_MAX_MOVES];
+        bool unsettled[BATCH_MAX_MOVES];
+
+        // Children left with a capture to make are settled past forced replies first, what they
+        // reach joins the batch unless a choice of captures is still to be played out
+        UINT turn_next = is_max_node ? BLACK : WHITE;
+        for(int i = 0; i < n; i++) {
+            WP_leaf[i] = WP_next[i] = WP ^ moves[i].WM;
+            BP_leaf[i] = BP_next[i] = BP ^ moves[i].BM;
+            K_leaf[i] = K_next[i] = K ^ moves[i].KM;
+            turn_leaf[i] = turn_next;
+            qply_leaf[i] = 0;
+            unsettled[i] = play_forced_captures(turn_leaf[i],WP_leaf[i],BP_leaf[i],K_leaf[i],qply_leaf[i]);
+        }
+        heuristics_batch(WP_leaf,BP_leaf,K_leaf,n,values);
+        m_nodes += n;
+
+        // Those repeating a position are draws
+        for(int i = 0; i < n; i++) {
+            if(unsettled[i])
+                values[i] = quiescence(turn_leaf[i] == WHITE,INFTY_N,INFTY_P,WP_leaf[i],BP_leaf[i],K_leaf[i],qply_leaf[i]);
+            int floor = push_search_path(key,moves[i]);
+            if(is_search_draw(hash_position(WP_next[i],BP_next[i],K_next[i],turn_next)))
+                values[i] = 0;
+            pop_search_path(floor);
+        }
+    }
+    int alpha_beta_minimax(bool is_max_node, int depth, int min, int max, UINT WP, UINT BP, UINT K) {
+        if(!m_tracer)
+            return alpha_beta_node(is_max_node,depth,min,max,WP,BP,K);
+        int score = alpha_beta_node(is_max_node,depth,min,max,WP,BP,K);
+        m_tracer->record(WP,BP,K,is_max_node,root_depth - depth,depth,min,max,score);
+        return score;
+    }
+    int alpha_beta_node(bool is_max_node, int depth, int min, int max, UINT WP, UINT BP, UINT K) {
+
+        m_nodes++;
+        int ply = root_depth - depth;
+        if(ply < MAX_PLY)
+            m_pv_length[ply] = ply;
+        if(search_time_up())
+            return is_max_node ? INFTY_P : INFTY_N;
+
+        // A repeated position or one that hit the no-progress limit is a draw
+        UINT64 key = hash_position(WP,BP,K,is_max_node ? WHITE : BLACK);
+        if(depth != root_depth && is_search_draw(key))
+            return 0;
+        UINT64 draws = m_search_draws;
+
+        // depth is 0 or node is leaf, return value
+        if(depth == 0)
+            return quiescence(is_max_node,min,max,WP,BP,K,0);
+
+        // Check the transposition table, the root always searches so best_move_temp gets set
+        UINT64 tt_key = canonical_key(WP,BP,K,is_max_node ? WHITE : BLACK);
+        TTData tt;
+        bool tt_hit = trans_table.probe(tt_key,tt,!is_max_node);
+        m_tt_probes++;
+        if(tt_hit) {
+            m_tt_hits++;
+            if(tt.depth >= depth && depth != root_depth) {
+                if(tt.flag == TT_EXACT)
+                    return tt.score;
+                if(tt.flag == TT_LOWER && tt.score >= max)
+                    return max;
+                if(tt.flag == TT_UPPER && tt.score <= min)
+                    return min;
+            }
+        }
+
+        // Get moves of current player
+        vector<Move> moves;
+        get_moves(is_max_node ? WHITE : BLACK, WP, BP, K, end_temp, moves);
+        is_leaf_node = false;
+        if(moves.empty()) {
+            is_leaf_node = true;
+            return  is_max_node ? INFTY_N + depth : INFTY_P - depth;
+        }
+
+        // Captures by what they net, then the move stored in the table first
+        int exchanges[BATCH_MAX_MOVES];
+        if(moves.size() > 1 && (is_max_node ? moves[0].BM : moves[0].WM))
+            order_captures(is_max_node ? WHITE : BLACK,WP,BP,K,moves,exchanges);
+        if(tt_hit && tt.has_move) {
+            for(size_t i = 1; i < moves.size(); i++) {
+                if(moves[i] == Move(tt.start,tt.end)) {
+                    swap(moves[0],moves[i]);
+                    break;
+                }
+            }
+        }
+        if(m_follow_pv)
+            order_pv_move(ply,moves);
+
+        int min_orig = min, max_orig = max;
+        int best = -1;
+
+        // One ply above the leaves all children are evaluated together
+        int leaf_values[BATCH_MAX_MOVES];
+        bool batched = depth == 1 && moves.size() <= BATCH_MAX_MOVES;
+        if(batched) {
+            evaluate_children(is_max_node,key,WP,BP,K,moves,leaf_values);
+            if(ply + 1 < MAX_PLY)
+                m_pv_length[ply+1] = ply + 1;
+        }
+
+        // Max function
+        if(is_max_node) {
+            for(int i = 0; i < moves.size(); i++) {
+                Move move = moves[i];
+                UINT WP_next = WP ^ move.WM;
+                UINT BP_next = BP ^ move.BM;
+                UINT K_next = K ^ move.KM;
+                int value;
+                if(batched) {
+                    value = leaf_values[i];
+                    if(m_tracer)
+                        m_tracer->record(WP_next,BP_next,K_next,!is_max_node,ply + 1,0,min,max,value);
+                }
+                else {
+                    int floor = push_search_path(key,move);
+                    value = alpha_beta_minimax(!is_max_node,depth-1,min,max,WP_next,BP_next,K_next);
+                    pop_search_path(floor);
+                }
+                m_follow_pv = false;
+
+                if(value > min) {
+                    min = value;
+                    best = i;
+                    update_pv(ply,move);
+                    if(depth == root_depth)
+                        best_move_temp = move;
+                }
+
+                if(min >= max) {
+                    if(!search_time_up() && m_search_draws == draws)
+                        trans_table.store(tt_key,min,depth,TT_LOWER,true,move.start,move.end,false);
+                    return max;
+                }
+            }
+        }
+
+        // Min function
+        else {
+            for(int i = 0; i < moves.size(); i++) {
+                Move move = moves[i];
+                UINT WP_next = WP ^ move.WM;
+                UINT BP_next = BP ^ move.BM;
+                UINT K_next = K ^ move.KM;
+                int value;
+                if(batched) {
+                    value = leaf_values[i];
+                    if(m_tracer)
+                        m_tracer->record(WP_next,BP_next,K_next,!is_max_node,ply + 1,0,min,max,value);
+                }
+                else {
+                    int floor = push_search_path(key,move);
+                    value = alpha_beta_minimax(!is_max_node,depth-1,min,max,WP_next,BP_next,K_next);
+                    pop_search_path(floor);
+                }
+                m_follow_pv = false;
+
+                if(value < max) {
+                    max = value;
+                    best = i;
+                    update_pv(ply,move);
+                    if(depth == root_depth)
+                        best_move_temp = move;
+                }
+
+                if(max <= min) {
+                    if(!search_time_up() && m_search_draws == draws)
+                        trans_table.store(tt_key,max,depth,TT_UPPER,true,move.start,move.end,true);
+                    return min;
+                }
+            }
+        }
+
+        // Store the result, it is only exact if it landed inside the original window
+        if(!search_time_up() && m_search_draws == draws) {
+            int value = is_max_node ? min : max;
+            int flag = TT_EXACT;
+            if(is_max_node && value <= min_orig)
+                flag = TT_UPPER;
+            else if(!is_max_node && value >= max_orig)
+                flag = TT_LOWER;
+            if(best >= 0)
+                trans_table.store(tt_key,value,depth,flag,true,moves[best].start,moves[best].end,!is_max_node);
+            else
+                trans_table.store(tt_key,value,depth,flag,false,0,0,!is_max_node);
+        }
+
+        return is_max_node ? min : max;
+    }
+    //
+    // ASYNCHRONOUS SEARCH
+    //
+    // Searches the current position on a thread of its own and returns at once. on_iteration,
+    // if set, runs on that thread after every completed depth. The Game must be left alone
+    // until the job is done. wait() gives the best move, Move(0,0,0,0,0) if there is none.
+    shared_ptr<SearchJob> search_async(int max_depth, int time_ms, function<void(const SearchInfo &)> on_iteration) {
+        shared_ptr<SearchJob> job(new SearchJob);
+        SearchJob *j = job.get();
+        j->worker = thread([this, j, max_depth, time_ms, on_iteration]() {
+            m_stop_token = &j->stop_token;
+            m_on_iteration = on_iteration;
+            m_deadline = time_ms ? now_ms() + time_ms : 0;
+            Move move = search_position(max_depth);
+            m_deadline = 0;
+            m_stop_token = NULL;
+            m_on_iteration = nullptr;
+            j->best.set_value(move);
+        });
+        return job;
+    }
+
+    //
+    // TIME MANAGEMENT
+    //
+    // Per move budget from m_clock, the hard limit is polled by the search through m_deadline
+    void start_clock_search() {
+        long long soft, hard;
+        m_clock.budget(m_turn,get_bit_count(m_WP | m_BP),soft,hard);
+        m_search_start = now_ms();
+        m_soft_deadline = m_search_start + ::max(soft,1LL);
+        m_deadline = m_search_start + ::max(hard,1LL);
+    }
+    // Between iterations: a best move that just changed buys half the target again,
+    // one that held for four depths stops at half of it
+    bool within_soft_target(int stable) {
+        long long target = m_soft_deadline - m_search_start;
+        if(stable == 0)
+            target += target / 2;
+        else if(stable >= 4)
+            target /= 2;
+        return now_ms() - m_search_start < target;
+    }
+
+    void itr_deepening(bool is_max_node, int start_depth, int end_depth) {
+
+        // Begin search
+        // cout << "MiniMax Iterative deepening in progress..." << endl;
+        int depth, stable = 0;
+        long long start = now_ms();
+        m_root_pv.clear();
+        for(depth = start_depth; depth <= end_depth; depth++) {
+            root_depth = depth;
+            m_follow_pv = true;
+            int score = alpha_beta_minimax(is_max_node,depth,INFTY_N,INFTY_P,m_WP,m_BP,m_K);
+
+            if(search_time_up()) {
+                // cout << "CPU time limit for searching was reached." << endl;
+                break;
+            }
+            else {
+                stable = (best_move_temp == best_move) ? stable + 1 : 0;
+                best_move = best_move_temp;
+                cpu_maxdepth = depth;
+                m_root_pv.assign(m_pv[0],m_pv[0] + m_pv_length[0]);
+                m_root_score = score;
+                if(m_show_pv)
+                    cout << "depth " << setw(2) << depth << "  score " << setw(11) << score
+                         << "  nodes " << m_nodes << "  pv " << pv_string() << endl;
+                if(m_on_iteration) {
+                    SearchInfo info = { depth, score, best_move, m_nodes, now_ms() - start, m_root_pv };
+                    m_on_iteration(info);
+                }
+            }
+
+            if(m_soft_deadline && !within_soft_target(stable))
+                break;
+
+            if(is_leaf_node)
+                break;
+        }
+        if(m_tracer)
+            m_tracer->flush();
+    }
+
+    //
+    // MULTI-PV ANALYSIS
+    //
+    // The first k root moves get exact scores from full window searches. Every later move is only
+    // tested against the k-th best score with a null window and searched again if it beats it.
+    // One table serves all the root moves, and each line's last PV seeds its next depth.
+    struct PvLine {
+        Move move;
+        int score;
+        bool exact;
+        vector<Move> pv;
+    };
+    bool is_better(bool is_max_node, int a, int b) {
+        return is_max_node ? a > b : a < b;
+    }
+    // One depth over the root moves of lines, reordered best first. False if the search ran out of time
+    bool multi_pv_iteration(int k, int depth, vector<PvLine> &lines) {
+        bool is_max_node = m_turn == WHITE;
+        UINT64 key = hash_position(m_WP,m_BP,m_K,m_turn);
+        root_depth = depth;
+        vector<int> exact_scores;
+        for(size_t i = 0; i < lines.size(); i++) {
+            PvLine &line = lines[i];
+            UINT WP_next = m_WP ^ line.move.WM;
+            UINT BP_next = m_BP ^ line.move.BM;
+            UINT K_next = m_K ^ line.move.KM;
+            m_root_pv = line.pv;
+            m_follow_pv = !line.pv.empty();
+
+            // Nothing beats a k-th score that is already the side's best bound, and the null window
+            // around it would overflow
+            int floor = push_search_path(key,line.move);
+            bool full = exact_scores.size() < (size_t)k;
+            if(!full && exact_scores[k-1] == (is_max_node ? INFTY_P : INFTY_N)) {
+                line.score = exact_scores[k-1];
+                line.exact = false;
+            }
+            else if(!full) {
+                int kth = exact_scores[k-1];
+                int value = is_max_node ? alpha_beta_minimax(false,depth-1,kth,kth+1,WP_next,BP_next,K_next)
+                                        : alpha_beta_minimax(true,depth-1,kth-1,kth,WP_next,BP_next,K_next);
+                full = is_better(is_max_node,value,kth);
+                line.score = kth;
+                line.exact = false;
+            }
+            if(full) {
+                m_follow_pv = !line.pv.empty();
+                line.score = alpha_beta_minimax(!is_max_node,depth-1,INFTY_N,INFTY_P,WP_next,BP_next,K_next);
+                line.exact = true;
+                line.pv.assign(1,line.move);
+                line.pv.insert(line.pv.end(),m_pv[1] + 1,m_pv[1] + m_pv_length[1]);
+                exact_scores.push_back(line.score);
+                sort(exact_scores.begin(),exact_scores.end());
+                if(is_max_node)
+                    reverse(exact_scores.begin(),exact_scores.end());
+            }
+            pop_search_path(floor);
+            if(search_time_up())
+                break;
+        }
+        if(m_tracer)
+            m_tracer->record(m_WP,m_BP,m_K,is_max_node,0,depth,INFTY_N,INFTY_P,exact_scores.empty() ? 0 : exact_scores[0]);
+        if(search_time_up())
+            return false;
+
+        // Exact lines best first, the ones only proven worse keep their order behind them
+        stable_sort(lines.begin(),lines.end(),[&](const PvLine &a, const PvLine &b) {
+            if(a.exact != b.exact)
+                return a.exact;
+            return a.exact && is_better(is_max_node,a.score,b.score);
+        });
+        return true;
+    }
+    // Prints the k best lines of the current position for every depth up to max_depth
+    void analyze_multi_pv(int k, int max_depth, int time_ms) {
+        vector<PvLine> lines;
+        if(!get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves)) {
+            cout << "No legal moves." << endl;
+            return;
+        }
+        for(size_t i = 0; i < m_moves.size(); i++) {
+            PvLine line;
+            line.move = m_moves[i];
+            line.score = 0;
+            line.exact = false;
+            lines.push_back(line);
+        }
+        k = ::max(1,::min(k,(int)lines.size()));
+
+        if(!trans_table.is_allocated())
+            trans_table.resize(TT_DEFAULT_MB);
+        trans_table.new_search();
+        init_search_path();
+        use_eval_cache();
+        cpu_time_up = false;
+        m_stop = false;
+        m_nodes = 0;
+        long long start = now_ms();
+        m_deadline = time_ms ? start + time_ms : 0;
+        for(int depth = 1; depth <= max_depth; depth++) {
+            if(!multi_pv_iteration(k,depth,lines))
+                break;
+            for(int i = 0; i < k; i++) {
+                string pv;
+                for(size_t j = 0; j < lines[i].pv.size(); j++)
+                    pv += (j ? " " : "") + move_to_pdn(lines[i].pv[j]);
+                cout << "depth " << setw(2) << depth << "  multipv " << i + 1 << "  score " << setw(11) << lines[i].score
+                     << "  nodes " << m_nodes << "  ms " << (now_ms() - start) << "  pv " << pv << endl;
+            }
+        }
+        m_deadline = 0;
+    }
+    
+
+    //
+    // CAPTURE EXCHANGES
+    //
+    // Captures are compulsory, so after a capture the other side keeps jumping while it has
+    // jumpers and the exchange only ends at a side without one. exchange_value() plays those
+    // forced replies out, each side taking its best capture, and counts the material in
+    // W_PAWN/W_KING with promotions worth the difference.
+    int capture_gain(UINT turn, UINT K, const Move &move) {
+        UINT captured = turn == WHITE ? move.BM : move.WM;
+        UINT promoted = (K ^ move.KM) & ~K;
+        return get_bit_count(captured & ~K) * W_PAWN + get_bit_count(captured & K) * W_KING
+             + get_bit_count(promoted) * (W_KING - W_PAWN);
+    }
+    // Best net gain of turn's forced captures, 0 if it has none
+    int exchange_reply(UINT turn, UINT WP, UINT BP, UINT K, int plies) {
+        UINT jumpers = turn == WHITE ? get_jumpers_W(WP,BP,K) : get_jumpers_B(WP,BP,K);
+        if(!jumpers || plies == 0)
+            return 0;
+        vector<Move> &moves = m_exchange_moves[plies];
+        UINT end;
+        get_moves(turn,WP,BP,K,end,moves);
+        int best = INFTY_N;
+        for(size_t i = 0; i < moves.size(); i++)
+            best = ::max(best, capture_gain(turn,K,moves[i])
+                             - exchange_reply(!turn,WP ^ moves[i].WM,BP ^ moves[i].BM,K ^ moves[i].KM,plies - 1));
+        return best;
+    }
+    // Net material turn wins with move once the captures run out
+    int exchange_value(UINT turn, UINT WP, UINT BP, UINT K, const Move &move) {
+        return capture_gain(turn,K,move)
+             - exchange_reply(!turn,WP ^ move.WM,BP ^ move.BM,K ^ move.KM,EXCHANGE_MAX_PLIES);
+    }
+    // Sorts captures best exchange first, values (BATCH_MAX_MOVES long) receives the exchanges
+    void order_captures(UINT turn, UINT WP, UINT BP, UINT K, vector<Move> &moves, int *values) {
+        int n = ::min((int)moves.size(),BATCH_MAX_MOVES);
+        for(int i = 0; i < n; i++)
+            values[i] = exchange_value(turn,WP,BP,K,moves[i]);
+        for(int i = 1; i < n; i++) {
+            Move move = moves[i];
+            int value = values[i], j = i;
+            for(; j > 0 && values[j-1] < value; j--) {
+                moves[j] = moves[j-1];
+                values[j] = values[j-1];
+            }
+            moves[j] = move;
+            values[j] = value;
+        }
+    }
+
+    // Plays the capture while turn has only one, as quiescence() would have searched it alone.
+    // True if the position reached still has a choice of captures to search, qply is updated.
+    bool play_forced_captures(UINT &turn, UINT &WP, UINT &BP, UINT &K, int &qply) {
+        vector<Move> &moves = m_forced_moves;
+        UINT end;
+        while(qply < QS_MAX_PLIES && WP && BP && (turn == WHITE ? get_jumpers_W(WP,BP,K) : get_jumpers_B(WP,BP,K))) {
+            get_moves(turn,WP,BP,K,end,moves);
+            if(moves.size() > 1)
+                return true;
+            if(qply > 0)
+                m_nodes++;
+            WP ^= moves[0].WM;
+            BP ^= moves[0].BM;
+            K ^= moves[0].KM;
+            turn = !turn;
+            qply++;
+        }
+        return false;
+    }
+
+    // Leaf value once pending captures are played out, since a side that has to jump is not at
+    // rest yet. Captures losing QS_PRUNE_MARGIN more than the best exchange on offer are not
+    // searched; one capture always is, as the side cannot decline them all.
+    int quiescence(bool is_max_node, int min, int max, UINT WP, UINT BP, UINT K, int qply) {
+        UINT turn = is_max_node ? WHITE : BLACK;
+        UINT jumpers = turn == WHITE ? get_jumpers_W(WP,BP,K) : get_jumpers_B(WP,BP,K);
+        if(!jumpers || qply >= QS_MAX_PLIES || !WP || !BP)
+            return heuristics(WP,BP,K);
+        if(qply > 0)
+            m_nodes++;
+
+        vector<Move> &moves = m_qs_moves[qply];
+        UINT end;
+        get_moves(turn,WP,BP,K,end,moves);
+        int exchanges[BATCH_MAX_MOVES];
+        if(moves.size() > 1)
+            order_captures(turn,WP,BP,K,moves,exchanges);
+
+        // Children are settled past forced replies, those left without a choice of captures are
+        // leaves and several of them are evaluated as one batch
+        int n = ::min((int)moves.size(),BATCH_MAX_MOVES), leaf_values[BATCH_MAX_MOVES], leaves = 0;
+        while(n > 1 && exchanges[n-1] < exchanges[0] - QS_PRUNE_MARGIN)
+            n--;
+        UINT WP_next[BATCH_MAX_MOVES], BP_next[BATCH_MAX_MOVES], K_next[BATCH_MAX_MOVES], turn_next[BATCH_MAX_MOVES];
+        UINT WP_leaf[BATCH_MAX_MOVES], BP_leaf[BATCH_MAX_MOVES], K_leaf[BATCH_MAX_MOVES];
+        int qply_next[BATCH_MAX_MOVES];
+        bool unsettled[BATCH_MAX_MOVES];
+        for(int i = 0; i < n; i++) {
+            WP_next[i] = WP ^ moves[i].WM;
+            BP_next[i] = BP ^ moves[i].BM;
+            K_next[i] = K ^ moves[i].KM;
+            turn_next[i] = !turn;
+            qply_next[i] = qply + 1;
+            unsettled[i] = play_forced_captures(turn_next[i],WP_next[i],BP_next[i],K_next[i],qply_next[i]);
+            if(!unsettled[i]) {
+                WP_leaf[leaves] = WP_next[i];
+                BP_leaf[leaves] = BP_next[i];
+                K_leaf[leaves++] = K_next[i];
+            }
+        }
+        if(leaves > 1)
+            heuristics_batch(WP_leaf,BP_leaf,K_leaf,leaves,leaf_values);
+        else if(leaves == 1)
+            leaf_values[0] = heuristics(WP_leaf[0],BP_leaf[0],K_leaf[0]);
+
+        for(int i = 0, leaf = 0; i < n; i++) {
+            int value = unsettled[i] ? quiescence(turn_next[i] == WHITE,min,max,WP_next[i],BP_next[i],K_next[i],qply_next[i]) : leaf_values[leaf++];
+            if(is_max_node && value > min)
+                min = value;
+            if(!is_max_node && value < max)
+                max = value;
+            if(min >= max)
+                return is_max_node ? max : min;
+        }
+        return is_max_node ? min : max;
+    }
+
+
+    //
+    // HEURISTICS FUNCTION
+    //
+    int heuristics(UINT WP, UINT BP, UINT K) {
+        if(!WP) return INFTY_N;
+        if(!BP) return INFTY_P;
+        int return_value = static_eval(WP,BP,K);
+
+        // Add a slight randomness to the value
+        if(m_eval_noise)
+            return_value += ((rand() % 2001) - 1000);
+        return return_value;
+    }
+    // heuristics() without the noise, from the evaluation cache when it has the board
+    int static_eval(UINT WP, UINT BP, UINT K) {
+        if(!eval_cache.is_enabled())
+            return heuristics_padded(pad_board(WP),pad_board(BP),pad_board(K));
+        UINT64 key = EvalCache::key_of(WP,BP,K);
+        int score;
+        m_eval_probes++;
+        if(eval_cache.probe(key,score))
+            m_eval_hits++;
+        else {
+            score = heuristics_padded(pad_board(WP),pad_board(BP),pad_board(K));
+            eval_cache.store(key,score);
+        }
+        return score;
+    }
+    // heuristics() on a padded board without the noise, each term counted over a whole mask
+    int heuristics_padded(UINT64 WP, UINT64 BP, UINT64 K) {
+        if(!WP) return INFTY_N;
+        if(!BP) return INFTY_P;
+        int return_value = 0;
+        int offset = 1e4;
+        UINT64 WPawns = WP&(~K), WK = WP&K;
+        UINT64 BPawns = BP&(~K), BK = BP&K;
+
+        // Number of each piece on board
+        int w_pawn_count = __builtin_popcountll(WPawns);
+        int b_pawn_count = __builtin_popcountll(BPawns);
+        int w_king_count = __builtin_popcountll(WK);
+        int b_king_count = __builtin_popcountll(BK);
+        int white_count = w_pawn_count + 1.5*w_king_count;
+        int black_count = b_pawn_count + 1.5*b_king_count;
+
+        // Pawns on the opponent's starting side score W_PAWN_ADVANCED instead of W_PAWN,
+        // and those still on their first row get W_FIRST_ROW more
+        return_value += offset*W_PAWN*(__builtin_popcountll(WPawns & ~PMASK_B_SIDE) - __builtin_popcountll(BPawns & ~PMASK_W_SIDE));
+        return_value += offset*W_PAWN_ADVANCED*(__builtin_popcountll(WPawns & PMASK_B_SIDE) - __builtin_popcountll(BPawns & PMASK_W_SIDE));
+        return_value += offset*W_FIRST_ROW*(__builtin_popcountll(WPawns & PMASK_BOT) - __builtin_popcountll(BPawns & PMASK_TOP));
+
+        // Points for kings and for pieces that can jump
+        return_value += offset*W_KING*(w_king_count - b_king_count);
+        return_value += offset*W_JUMPER*(__builtin_popcountll(padded_jumpers(WHITE,WP,BP,K)) - __builtin_popcountll(padded_jumpers(BLACK,WP,BP,K)));
+
+        // Edges are discouraged for kings
+        if(WK & PMASK_EDGES) return_value -= offset*W_KING_EDGE;
+        if(BK & PMASK_EDGES) return_value += offset*W_KING_EDGE;
+
+        // When both players have less than 6 pieces (pawns count as 1, kings count as 1.5),
+        // Winning player will be more aggressive
+        // Losing player will be more defensive
+        if(white_count < 6 && black_count < 6) {
+            if(white_count > black_count) {
+                if(BP & PMASK_DBLCORNERS)
+                    return_value -= offset*W_DBLCORNER;
+                return_value -= offset*b_pawn_count*W_ENDGAME_PAWN;
+                return_value -= offset*b_king_count*W_ENDGAME_KING;
+            }
+            else if(white_count < black_count) {
+                if(WP & PMASK_DBLCORNERS)
+                    return_value += offset*W_DBLCORNER;
+                return_value += offset*w_pawn_count*W_ENDGAME_PAWN;
+                return_value += offset*w_king_count*W_ENDGAME_KING;
+            }
+        }
+        return return_value;
+    }
+
+    // Terms of heuristics() from white's side, one per weight in CheckersWeights.h (EVAL_TERM_NAMES order)
+    // Without noise and away from the no-piece cases heuristics() is offset * sum(weight * term)
+    void eval_features(UINT WP, UINT BP, UINT K, int f[NUM_EVAL_TERMS]) {
+        const UINT WHITE_SIDE = 0xFFF00000, BLACK_SIDE = 0x00000FFF;
+        UINT WPawns = WP&(~K), WK = WP&K;
+        UINT BPawns = BP&(~K), BK = BP&K;
+
+        int w_pawn_count = get_bit_count(WPawns);
+        int b_pawn_count = get_bit_count(BPawns);
+        int w_king_count = get_bit_count(WK);
+        int b_king_count = get_bit_count(BK);
+        int white_count = w_pawn_count + 1.5*w_king_count;
+        int black_count = b_pawn_count + 1.5*b_king_count;
+
+        f[0] = get_bit_count(WPawns & ~BLACK_SIDE) - get_bit_count(BPawns & ~WHITE_SIDE);
+        f[1] = get_bit_count(WPawns & BLACK_SIDE) - get_bit_count(BPawns & WHITE_SIDE);
+        f[2] = get_bit_count(WPawns & MASK_BOT) - get_bit_count(BPawns & MASK_TOP);
+        f[3] = w_king_count - b_king_count;
+        f[4] = get_bit_count(get_jumpers_W(WP,BP,K)) - get_bit_count(get_jumpers_B(WP,BP,K));
+        f[5] = ((BK & MASK_EDGES) ? 1 : 0) - ((WK & MASK_EDGES) ? 1 : 0);
+        f[6] = f[7] = f[8] = 0;
+        if(white_count < 6 && black_count < 6) {
+            if(white_count > black_count) {
+                f[6] = (BP & (MASK_DBLCORNER1 | MASK_DBLCORNER2)) ? -1 : 0;
+                f[7] = -b_pawn_count;
+                f[8] = -b_king_count;
+            }
+            else if(white_count < black_count) {
+                f[6] = (WP & (MASK_DBLCORNER1 | MASK_DBLCORNER2)) ? 1 : 0;
+                f[7] = w_pawn_count;
+                f[8] = w_king_count;
+            }
+        }
+    }
+
+    //
+    // BATCHED HEURISTICS
+    //
+    // heuristics() for a whole frontier at once. Every term is a popcount of the boards under a
+    // fixed mask, so LANES positions sit side by side in one vector and share each instruction.
+    // The kernel is written once with vector extensions and compiled for AVX-512 and AVX2,
+    // batch_lanes picks the widest one the CPU has at start up (1 = plain heuristics()).
+    typedef UINT v8u __attribute__((vector_size(32)));
+    typedef int v8i __attribute__((vector_size(32)));
+    typedef UINT v16u __attribute__((vector_size(64)));
+    typedef int v16i __attribute__((vector_size(64)));
+    static int batch_lanes;
+
+    // Bit count of every lane, no AVX-512 VPOPCNTDQ needed
+    template<typename V>
+    static inline __attribute__((always_inline)) void lane_bit_count(const V &x, V &count) {
+        V t = x - ((x >> 1) & 0x55555555u);
+        t = (t & 0x33333333u) + ((t >> 2) & 0x33333333u);
+        t = (t + (t >> 4)) & 0x0F0F0F0Fu;
+        count = (t * 0x01010101u) >> 24;
+    }
+    template<typename V, typename VI>
+    inline __attribute__((always_inline)) void heuristics_lanes(const UINT *WP_in, const UINT *BP_in, const UINT *K_in, int *out) {
+        V WP, BP, K;
+        memcpy(&WP,WP_in,sizeof(V));
+        memcpy(&BP,BP_in,sizeof(V));
+        memcpy(&K,K_in,sizeof(V));
+        const int offset = 1e4;
+        const UINT WHITE_SIDE = 0xFFF00000, BLACK_SIDE = 0x00000FFF;
+        const UINT DBLCORNERS = MASK_DBLCORNER1 | MASK_DBLCORNER2;
+        V UOCC = ~(WP|BP);
+        V WPawns = WP&(~K), WK = WP&K;
+        V BPawns = BP&(~K), BK = BP&K;
+
+        // get_jumpers_W() and get_jumpers_B() without the early outs
+        V temp = (UOCC << 4) & BP;
+        V Wjump = (((temp & MASK_L3) << 3) | ((temp & MASK_L5) << 5)) & WP;
+        temp = (((UOCC & MASK_L3) << 3) | ((UOCC & MASK_L5) << 5)) & BP;
+        Wjump |= (temp << 4) & WP;
+        temp = (UOCC >> 4) & BP;
+        Wjump |= (((temp & MASK_R3) >> 3) | ((temp & MASK_R5) >> 5)) & WK;
+        temp = (((UOCC & MASK_R3) >> 3) | ((UOCC & MASK_R5) >> 5)) & BP;
+        Wjump |= (temp >> 4) & WK;
+
+        temp = (UOCC >> 4) & WP;
+        V Bjump = (((temp & MASK_R3) >> 3) | ((temp & MASK_R5) >> 5)) & BP;
+        temp = (((UOCC & MASK_R3) >> 3) | ((UOCC & MASK_R5) >> 5)) & WP;
+        Bjump |= (temp >> 4) & BP;
+        temp = (UOCC << 4) & WP;
+        Bjump |= (((temp & MASK_L3) << 3) | ((temp & MASK_L5) << 5)) & BK;
+        temp = (((UOCC & MASK_L3) << 3) | ((UOCC & MASK_L5) << 5)) & WP;
+        Bjump |= (temp << 4) & BK;
+
+        // Same terms as eval_features()
+        V w_pawns, b_pawns, w_kings, b_kings, a, b;
+        lane_bit_count(WPawns,w_pawns);
+        lane_bit_count(BPawns,b_pawns);
+        lane_bit_count(WK,w_kings);
+        lane_bit_count(BK,b_kings);
+        VI value = ((VI)w_pawns - (VI)b_pawns) * W_PAWN + ((VI)w_kings - (VI)b_kings) * W_KING;
+        lane_bit_count(WPawns & BLACK_SIDE,a);
+        lane_bit_count(BPawns & WHITE_SIDE,b);
+        value += ((VI)a - (VI)b) * (W_PAWN_ADVANCED - W_PAWN);
+        lane_bit_count(WPawns & MASK_BOT,a);
+        lane_bit_count(BPawns & MASK_TOP,b);
+        value += ((VI)a - (VI)b) * W_FIRST_ROW;
+        lane_bit_count(Wjump,a);
+        lane_bit_count(Bjump,b);
+        value += ((VI)a - (VI)b) * W_JUMPER;
+        value += ((VI)((WK & MASK_EDGES) != 0) - (VI)((BK & MASK_EDGES) != 0)) * W_KING_EDGE;
+
+        // Endgame, comparisons give -1 in the lanes where they hold
+        VI white_count = (VI)w_pawns + (((VI)w_kings * 3) >> 1);
+        VI black_count = (VI)b_pawns + (((VI)b_kings * 3) >> 1);
+        VI endgame = (white_count < 6) & (black_count < 6);
+        VI white_ahead = endgame & (white_count > black_count);
+        VI black_ahead = endgame & (white_count < black_count);
+        VI w_corner = (VI)((WP & DBLCORNERS) != 0);
+        VI b_corner = (VI)((BP & DBLCORNERS) != 0);
+        value -= white_ahead & ((-b_corner) * W_DBLCORNER + (VI)b_pawns * W_ENDGAME_PAWN + (VI)b_kings * W_ENDGAME_KING);
+        value += black_ahead & ((-w_corner) * W_DBLCORNER + (VI)w_pawns * W_ENDGAME_PAWN + (VI)w_kings * W_ENDGAME_KING);
+        value *= offset;
+
+        // Sides with no pieces left
+        VI no_white = (VI)(WP == 0), no_black = (VI)(BP == 0) & ~no_white;
+        value = (value & ~(no_white | no_black)) | (no_white & INFTY_N) | (no_black & INFTY_P);
+        memcpy(out,&value,sizeof(VI));
+    }
+    __attribute__((target("avx2"))) void heuristics_avx2(const UINT *WP, const UINT *BP, const UINT *K, int *out) {
+        heuristics_lanes<v8u,v8i>(WP,BP,K,out);
+    }
+    __attribute__((target("avx512f"))) void heuristics_avx512(const UINT *WP, const UINT *BP, const UINT *K, int *out) {
+        heuristics_lanes<v16u,v16i>(WP,BP,K,out);
+    }
+    static int detect_batch_lanes() {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f"))
+            return 16;
+        if(__builtin_cpu_supports("avx2"))
+            return 8;
+        return 1;
+    }
+    // out[i] = heuristics(WP[i],BP[i],K[i]) for i < n. The lanes evaluate a group of boards in
+    // less time than the evaluation cache is probed for each, so only heuristics() consults it.
+    void heuristics_batch(const UINT *WP, const UINT *BP, const UINT *K, int n, int *out) {
+        int lanes = batch_lanes;
+        if(lanes == 1) {
+            for(int i = 0; i < n; i++)
+                out[i] = heuristics(WP[i],BP[i],K[i]);
+            return;
+        }
+        for(int i = 0; i < n; i += lanes) {
+            const UINT *wp = WP + i, *bp = BP + i, *k = K + i;
+            int *o = out + i;
+
+            // Pad the last group with empty boards
+            UINT pad[3][16];
+            int tail[16];
+            if(n - i < lanes) {
+                memset(pad,0,sizeof(pad));
+                memcpy(pad[0],wp,(n-i)*sizeof(UINT));
+                memcpy(pad[1],bp,(n-i)*sizeof(UINT));
+                memcpy(pad[2],k,(n-i)*sizeof(UINT));
+                wp = pad[0]; bp = pad[1]; k = pad[2];
+                o = tail;
+            }
+            if(lanes == 16)
+                heuristics_avx512(wp,bp,k,o);
+            else
+                heuristics_avx2(wp,bp,k,o);
+            if(o == tail)
+                memcpy(out+i,tail,(n-i)*sizeof(int));
+        }
+        if(m_eval_noise)
+            for(int i = 0; i < n; i++)
+                if(WP[i] && BP[i])
+                    out[i] += ((rand() % 2001) - 1000);
+    }
+
+    //
+    // BATCHED MOVE GENERATION
+    //
+    // get_walkers_W/B() and get_jumpers_W/B() for many boards at once, same kernel scheme as
+    // heuristics_batch(). The walk destinations come split by direction, so one set bit is one
+    // walk and boards without a capture never need get_moves().
+    struct MoverSets {
+        UINT *walkers, *jumpers;
+        UINT *dest[NUM_DIRS];
+    };
+    template<typename V>
+    inline __attribute__((always_inline)) void movers_lanes(UINT turn, const UINT *WP_in, const UINT *BP_in, const UINT *K_in, UINT *const out[2 + NUM_DIRS]) {
+        V WP, BP, K;
+        memcpy(&WP,WP_in,sizeof(V));
+        memcpy(&BP,BP_in,sizeof(V));
+        memcpy(&K,K_in,sizeof(V));
+        V UOCC = ~(WP|BP);
+        V opp = (turn == WHITE) ? BP : WP;
+        V up = (turn == WHITE) ? WP : (BP & K);
+        V down = (turn == WHITE) ? (WP & K) : BP;
+
+        // Squares reached by a walk, index going down (Up_*) or up (Down_*)
+        V dest[NUM_DIRS];
+        dest[DIR_UP4] = (up >> 4) & UOCC;
+        dest[DIR_UP35] = (((up >> 3) & MASK_L3) | ((up >> 5) & MASK_L5)) & UOCC;
+        dest[DIR_DOWN4] = (down << 4) & UOCC;
+        dest[DIR_DOWN35] = (((down << 3) & MASK_R3) | ((down << 5) & MASK_R5)) & UOCC;
+        V walkers = (dest[DIR_UP4] << 4) | ((dest[DIR_UP35] & MASK_L3) << 3) | ((dest[DIR_UP35] & MASK_L5) << 5)
+                  | (dest[DIR_DOWN4] >> 4) | ((dest[DIR_DOWN35] & MASK_R3) >> 3) | ((dest[DIR_DOWN35] & MASK_R5) >> 5);
+
+        // A jumper has an opponent piece next to it and an empty square behind that
+        V temp = (UOCC << 4) & opp;
+        V jumpers = (((temp & MASK_L3) << 3) | ((temp & MASK_L5) << 5)) & up;
+        temp = (((UOCC & MASK_L3) << 3) | ((UOCC & MASK_L5) << 5)) & opp;
+        jumpers |= (temp << 4) & up;
+        temp = (UOCC >> 4) & opp;
+        jumpers |= (((temp & MASK_R3) >> 3) | ((temp & MASK_R5) >> 5)) & down;
+        temp = (((UOCC & MASK_R3) >> 3) | ((UOCC & MASK_R5) >> 5)) & opp;
+        jumpers |= (temp >> 4) & down;
+
+        memcpy(out[0],&walkers,sizeof(V));
+        memcpy(out[1],&jumpers,sizeof(V));
+        for(int d = 0; d < NUM_DIRS; d++)
+            memcpy(out[2+d],&dest[d],sizeof(V));
+    }
+    __attribute__((target("avx2"))) void movers_avx2(UINT turn, const UINT *WP, const UINT *BP, const UINT *K, UINT *const out[2 + NUM_DIRS]) {
+        movers_lanes<v8u>(turn,WP,BP,K,out);
+    }
+    __attribute__((target("avx512f"))) void movers_avx512(UINT turn, const UINT *WP, const UINT *BP, const UINT *K, UINT *const out[2 + NUM_DIRS]) {
+        movers_lanes<v16u>(turn,WP,BP,K,out);
+    }
+    // Movers of the side to move for boards 0..n-1, each array of out holds n entries
+    void movers_batch(UINT turn, const UINT *WP, const UINT *BP, const UINT *K, int n, MoverSets &out) {
+        int lanes = batch_lanes;
+        for(int i = 0; i < n; i += lanes) {
+            const UINT *wp = WP + i, *bp = BP + i, *k = K + i;
+            UINT *rows[2 + NUM_DIRS] = { out.walkers + i, out.jumpers + i };
+            for(int d = 0; d < NUM_DIRS; d++)
+                rows[2+d] = out.dest[d] + i;
+
+            // Pad the last group with empty boards
+            UINT pad[3][16], tail[2 + NUM_DIRS][16];
+            bool padded = n - i < lanes;
+            if(padded) {
+                memset(pad,0,sizeof(pad));
+                memcpy(pad[0],wp,(n-i)*sizeof(UINT));
+                memcpy(pad[1],bp,(n-i)*sizeof(UINT));
+                memcpy(pad[2],k,(n-i)*sizeof(UINT));
+                wp = pad[0]; bp = pad[1]; k = pad[2];
+            }
+            UINT *const *dst = rows;
+            UINT *tail_rows[2 + NUM_DIRS];
+            if(padded) {
+                for(int r = 0; r < 2 + NUM_DIRS; r++)
+                    tail_rows[r] = tail[r];
+                dst = tail_rows;
+            }
+
+            if(lanes == 16)
+                movers_avx512(turn,wp,bp,k,dst);
+            else if(lanes == 8)
+                movers_avx2(turn,wp,bp,k,dst);
+            else
+                movers_lanes<UINT>(turn,wp,bp,k,dst);
+
+            if(padded)
+                for(int r = 0; r < 2 + NUM_DIRS; r++)
+                    memcpy(rows[r],tail[r],(n-i)*sizeof(UINT));
+        }
+    }
+
+    // Number of legal moves, counting walks straight from the destination sets
+    UINT64 count_moves(UINT turn, UINT WP, UINT BP, UINT K, UINT jumpers, UINT *const dest[NUM_DIRS], int i) {
+        if(jumpers) {
+            vector<Move> moves;
+            UINT end;
+            get_moves(turn,WP,BP,K,end,moves);
+            return moves.size();
+        }
+        UINT64 count = 0;
+        for(int d = 0; d < NUM_DIRS; d++)
+            count += get_bit_count(dest[d][i]);
+        return count;
+    }
+    // Walk number r (counting the destination sets in order) of a board without captures
+    Move pick_walk(UINT turn, UINT K, UINT *const dest[NUM_DIRS], int i, UINT r) {
+        for(int d = 0; d < NUM_DIRS; d++) {
+            UINT set = dest[d][i];
+            UINT count = get_bit_count(set);
+            if(r >= count) {
+                r -= count;
+                continue;
+            }
+            UINT end = get_lsb(set);
+            while(r--) {
+                set ^= S[end];
+                end = get_lsb(set);
+            }
+            UINT start;
+            if(d == DIR_UP4)
+                start = end + 4;
+            else if(d == DIR_UP35)
+                start = (S[end] & MASK_L3) ? end + 3 : end + 5;
+            else if(d == DIR_DOWN4)
+                start = end - 4;
+            else
+                start = (S[end] & MASK_R3) ? end - 3 : end - 5;
+
+            UINT PM = S[start] | S[end], KM;
+            if(K & S[start])
+                KM = PM;
+            else
+                KM = (S[end] & (turn == WHITE ? MASK_TOP : MASK_BOT)) ? S[end] : 0;
+            return (turn == WHITE) ? Move(start,end,PM,0,KM) : Move(start,end,0,PM,KM);
+        }
+        return Move(0,0,0,0,0);
+    }
+
+    // Leaf nodes depth plies below the board. The last two plies go through movers_batch()
+    UINT64 perft(UINT turn, UINT WP, UINT BP, UINT K, int depth) {
+        if(depth == 0)
+            return 1;
+        vector<Move> moves;
+        UINT end;
+        get_moves(turn,WP,BP,K,end,moves);
+        if(depth == 1)
+            return moves.size();
+
+        UINT64 nodes = 0;
+        int n = moves.size();
+        if(depth > 2 || n > BATCH_MAX_MOVES) {
+            for(int i = 0; i < n; i++)
+                nodes += perft(!turn,WP ^ moves[i].WM,BP ^ moves[i].BM,K ^ moves[i].KM,depth-1);
+            return nodes;
+        }
+
+        UINT walkers[BATCH_MAX_MOVES], jumpers[BATCH_MAX_MOVES], dest[NUM_DIRS][BATCH_MAX_MOVES];
+        MoverSets sets = { walkers, jumpers, { dest[0], dest[1], dest[2], dest[3] } };
+        for(int i = 0; i < n; i++) {
+            m_batch_WP[i] = WP ^ moves[i].WM;
+            m_batch_BP[i] = BP ^ moves[i].BM;
+            m_batch_K[i] = K ^ moves[i].KM;
+        }
+        movers_batch(!turn,m_batch_WP,m_batch_BP,m_batch_K,n,sets);
+        for(int i = 0; i < n; i++)
+            nodes += count_moves(!turn,m_batch_WP[i],m_batch_BP[i],m_batch_K[i],jumpers[i],sets.dest,i);
+        return nodes;
+    }
+    // Same count with get_moves() at every node, for checking perft()
+    UINT64 perft_scalar(UINT turn, UINT WP, UINT BP, UINT K, int depth) {
+        if(depth == 0)
+            return 1;
+        vector<Move> moves;
+        UINT end;
+        get_moves(turn,WP,BP,K,end,moves);
+        if(depth == 1)
+            return moves.size();
+        UINT64 nodes = 0;
+        for(size_t i = 0; i < moves.size(); i++)
+            nodes += perft_scalar(!turn,WP ^ moves[i].WM,BP ^ moves[i].BM,K ^ moves[i].KM,depth-1);
+        return nodes;
+    }
+    // Same count on the padded board throughout, the last ply counting walks from the destination sets
+    UINT64 perft_padded(UINT turn, UINT64 WP, UINT64 BP, UINT64 K, int depth) {
+        if(depth == 0)
+            return 1;
+        if(depth == 1 && !padded_jumpers(turn,WP,BP,K))
+            return padded_walk_count(turn,WP,BP,K);
+        vector<PaddedMove> moves;
+        UINT end;
+        get_padded_moves(turn,WP,BP,K,end,moves);
+        if(depth == 1)
+            return moves.size();
+        UINT64 nodes = 0;
+        for(size_t i = 0; i < moves.size(); i++)
+            nodes += perft_padded(!turn,WP ^ moves[i].WM,BP ^ moves[i].BM,K ^ moves[i].KM,depth-1);
+        return nodes;
+    }
+
+    // Plays n boards to the end with uniformly random moves, all boards moving in lockstep
+    // result[i] is RESULT_WHITE_WIN/BLACK_WIN, or RESULT_DRAW when not decided within max_plies
+    // plies, if not NULL, receives the total number of moves played
+    void random_playouts(UINT turn, const UINT *WP, const UINT *BP, const UINT *K, int n, int max_plies, int *result, UINT64 *plies = NULL) {
+        vector<UINT> wp(WP,WP+n), bp(BP,BP+n), k(K,K+n), walkers(n), jumpers(n), dest[NUM_DIRS];
+        vector<int> board(n);
+        for(int d = 0; d < NUM_DIRS; d++)
+            dest[d].resize(n);
+        for(int i = 0; i < n; i++) {
+            board[i] = i;
+            result[i] = RESULT_DRAW;
+        }
+        MoverSets sets = { walkers.data(), jumpers.data(), { dest[0].data(), dest[1].data(), dest[2].data(), dest[3].data() } };
+        vector<Move> moves;
+        UINT64 played = 0;
+
+        // wp/bp/k keep the live boards packed at the front, board[] maps them back to their index
+        for(int ply = 0; ply < max_plies && n > 0; ply++, turn = !turn) {
+            movers_batch(turn,wp.data(),bp.data(),k.data(),n,sets);
+            int live = 0;
+            for(int i = 0; i < n; i++) {
+                Move move;
+                if(jumpers[i]) {
+                    UINT end;
+                    get_moves(turn,wp[i],bp[i],k[i],end,moves);
+                    move = moves[rand() % moves.size()];
+                }
+                else {
+                    UINT count = count_moves(turn,wp[i],bp[i],k[i],0,sets.dest,i);
+                    if(count == 0) {
+                        result[board[i]] = (turn == WHITE) ? RESULT_BLACK_WIN : RESULT_WHITE_WIN;
+                        continue;
+                    }
+                    move = pick_walk(turn,k[i],sets.dest,i,rand() % count);
+                }
+                wp[live] = wp[i] ^ move.WM;
+                bp[live] = bp[i] ^ move.BM;
+                k[live] = k[i] ^ move.KM;
+                board[live] = board[i];
+                live++;
+            }
+            played += live;
+            n = live;
+        }
+        if(plies)
+            *plies = played;
+    }
+
+
+    //
+    // PRINT FUNCTIONS
+    //
+
+    // helper functions to convert between coordinates and bitnums
+    string bitnum_to_coord(UINT square_num) {
+        int r = square_num / 4;
+        int c = (square_num % 4) * 2;
+        if(r % 2 == 0)
+            c++;
+        int row = r + 1;
+        char col = char(c + 97);
+        stringstream ss;
+        ss << "(" << row << "," << col << ")";
+        return ss.str();
+    }
+    // Compact form, "6e", as typed in at the move prompt
+    string bitnum_to_short_coord(UINT square_num) {
+        string coord = bitnum_to_coord(square_num);
+        return string(1,coord[1]) + coord[3];
+    }
+    UINT coord_to_bitnum(int row, char col) {
+        int r = row - 1;
+        int c = int(col - 97);
+        if((r % 2 == 0 && c % 2 == 0) || (r % 2 == 1 && c % 2  == 1))
+            return 33;
+        if(r % 2 == 0)
+            c--;
+        c /= 2;
+        return  r * 4 + c;
+    }
+
+    void print_board(UINT WP, UINT BP, UINT K) {
+        cout << "\033[0m"; // return to default color for console
+
+        ios::fmtflags f = cout.flags();
+        cout << "\e[47m"
+             << "\e[1;31m" << "  Black:" << setw(2) << get_bit_count(m_BP)
+             << "\e[1;34m" << "   White:" << setw(2) << get_bit_count(m_WP) << "  "
+             << "\e[0m" << endl
+             << "\e[47m" << "                       " << "\e[0m" << endl;
+        cout.flags(f);
+
+        // Column letters (top)
+        cout << "\e[1;30;47m" << "     a b c d e f g h   " << "\e[0m" << endl
+             << "\e[1;30;47m" << "                       " << "\e[0m" << endl;
+
+        // i goes through pieces
+        // toggle determines format of empty square
+        // counter determines next line
+        UINT i, toggle = 0, counter = 0, row = 1;
+
+        for(i = 0; i < 32; i++) {
+
+            // ANSI escape sequence format
+            // "\e[n;n;nm"
+            // n represents a trait, bold, color, etc
+
+            if(counter == 0)
+                cout << "\e[47m" << "\e[1;30m" << row << "   " << "|";
+
+            if(toggle == 0)
+                cout << "\e[47m" << " " << "\e[1;30m" << "|";
+
+            if(WP & ~K & (1 << i))
+                cout << "\e[0m" << "\e[34;47m" << "w" << "\e[1;30m" << "|";
+            else if(WP & K & (1 << i))
+                cout << "\e[0m" << "\e[1;34;47m" << "W" << "\e[1;30m" << "|";
+            else if(BP & ~K & (1 << i))
+                cout << "\e[0m" << "\e[31;47m" << "b" << "\e[1;30m" << "|";
+            else if(BP & K & (1 << i))
+                cout << "\e[0m" << "\e[1;31;47m" << "B" << "\e[1;30m" << "|";
+            else
+                cout << "\e[47m" << " " << "\e[1;30m" <<  "|";
+
+
+            if(toggle == 1)
+                cout << "\e[47m" << " " << "\e[1;30m" << "|";
+
+
+            // Newline after 4 pieces
+            counter = (counter + 1) % 4;
+            if(counter == 0) {
+                toggle ^= 1;
+                cout << "\e[47m" << "  " << "\e[0m" << endl;
+                row++;
+            }
+        }
+    }
+
+    void print_legal_moves(vector<Move> moves) {
+        cout << "Legal moves: " << endl;
+
+        UINT start, end;
+        Move move;
+        vector<Move>::iterator itr;
+        for(itr = moves.begin(); itr != moves.end(); ++itr) {
+            move = *itr;
+            start = move.start;
+            end = move.end;
+            cout << bitnum_to_coord(start) << " => " << bitnum_to_coord(end) << endl;
+        }
+    }
+
+    void print_turn_info(UINT turn, int turn_num) {
+        cout << "Turn " << turn_num << ": ";
+        if(turn == WHITE)
+            cout << "White's turn." << endl;
+        else if(turn == BLACK)
+            cout << "Black's turn." << endl;
+        if(m_clock.enabled()) {
+            cout << fixed << setprecision(1) << "Clock: White " << m_clock.remaining(WHITE) / 1000.0
+                 << "s, Black " << m_clock.remaining(BLACK) / 1000.0 << "s" << endl;
+            cout.unsetf(ios::fixed);
+        }
+    }
+
+    // The side to move has no moves left and loses
+    void print_winner(UINT turn) {
+        cout << "No more possible moves left. The game is over!" << endl;
+        cout << (turn == WHITE ? "BLACK WINS!" : "WHITE WINS!") << endl;
+    }
+
+    void print_cpu_stats() {
+        streamsize ss = cout.precision();
+        cout << "CPU search time: " << fixed << setprecision(3) << cpu_time << endl;
+        cout.precision(ss);
+        cout << "Max depth searched: " << cpu_maxdepth << endl;
+    }
+
+
+    //
+    // NON-INTERACTIVE ACCESS (used by Server sessions)
+    //
+    void new_game(UINT turn) {
+        init_board(m_WP,m_BP,m_K);
+        m_turn = turn;
+        m_turn_num = 1;
+        end_temp = 0;
+        best_move = best_move_temp = Move(0,0,0,0,0);
+        reset_history();
+        get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves);
+    }
+
+    // Plays start->end if it is legal, without printing anything
+    bool apply_move(UINT start, UINT end) {
+        if(!get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves))
+            return false;
+        for(size_t i = 0; i < m_moves.size(); i++) {
+            if(m_moves[i] == Move(start,end)) {
+                m_WP ^= m_moves[i].WM;
+                m_BP ^= m_moves[i].BM;
+                m_K ^= m_moves[i].KM;
+                m_turn ^= 1;
+                m_turn_num++;
+                push_history(m_moves[i]);
+                get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void get_board(UINT &WP, UINT &BP, UINT &K, UINT &turn) {
+        WP = m_WP;
+        BP = m_BP;
+        K = m_K;
+        turn = m_turn;
+    }
+
+    bool is_game_over() {
+        return is_draw_by_rule() || !get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves);
+    }
+
+    // Returns false if the FEN is malformed
+    bool set_position(const string &fen) {
+        UINT WP, BP, K, turn;
+        if(!parse_fen(fen.data(),fen.data() + fen.size(),WP,BP,K,turn))
+            return false;
+        m_WP = WP;
+        m_BP = BP;
+        m_K = K;
+        m_turn = turn;
+        reset_history();
+        get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves);
+        return true;
+    }
+
+    string fen_string() {
+        char buf[FEN_MAX_LEN];
+        return string(buf, write_fen(buf,m_WP,m_BP,m_K,m_turn));
+    }
+
+    string legal_moves_string() {
+        stringstream ss;
+        get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves);
+        for(size_t i = 0; i < m_moves.size(); i++)
+            ss << (i ? " " : "") << bitnum_to_short_coord(m_moves[i].start) << "-" << bitnum_to_short_coord(m_moves[i].end);
+        return ss.str();
+    }
+
+    // Same rule as print_winner() and self-play: a side left without moves loses
+    string winner_string() {
+        if(m_time_loser >= 0)
+            return m_time_loser == WHITE ? "black" : "white";
+        if(!m_draw_reason.empty())
+            return "draw";
+        vector<Move> moves;
+        UINT end;
+        if(!get_moves(m_turn,m_WP,m_BP,m_K,end,moves))
+            return m_turn == WHITE ? "black" : "white";
+        return "draw";
+    }
+
+    void set_eval_noise(bool noise) { m_eval_noise = noise; }
+    UINT64 get_nodes() { return m_nodes; }
+    UINT64 get_tt_probes() { return m_tt_probes; }
+    UINT64 get_tt_hits() { return m_tt_hits; }
+    UINT64 get_eval_probes() { return m_eval_probes; }
+    UINT64 get_eval_hits() { return m_eval_hits; }
+    // Evaluation cache of kb kilobytes for this game's searches, 0 turns it off, and the calling thread's cache is resized now
+    void set_eval_cache(size_t kb) {
+        m_eval_cache_kb = kb;
+        use_eval_cache();
+    }
+    // Sizes the calling thread's evaluation cache for this game, every search calls it first
+    void use_eval_cache() {
+        if(eval_cache.size_kb() != m_eval_cache_kb)
+            eval_cache.resize(m_eval_cache_kb);
+    }
+    void clear_eval_cache() { eval_cache.clear(); }
+    void set_show_pv(bool show) { m_show_pv = show; }
+    bool set_clock(const string &spec) { return m_clock.parse(spec); }
+    void set_node_limit(UINT64 nodes) { m_node_limit = nodes; }
+    // Appends every searched node to path (see SearchTracer), an empty path stops tracing
+    bool set_trace(const string &path) {
+        m_tracer.reset();
+        if(path.empty())
+            return true;
+        m_tracer.reset(new SearchTracer());
+        if(!m_tracer->open(path)) {
+            m_tracer.reset();
+            return false;
+        }
+        return true;
+    }
+    const vector<Move> &get_pv() { return m_root_pv; }
+    int get_pv_score() { return m_root_score; }
+
+
+    //
+    // PDN GAME RECORDS
+    //
+    // Squares are numbered 1-32 (S[] index + 1). Black moves first in English checkers and is
+    // named first in PDN results, so "1-0" is a Black win and "0-1" a White win.
+    //
+    void set_pdn_path(const string &path) {
+        m_pdn_path = path;
+    }
+
+    // "11-15" for a walk, "22x15" for a jump (intermediate squares of multi-jumps are not kept)
+    string move_to_pdn(const Move &move) {
+        stringstream ss;
+        ss << move.start + 1 << ((move.WM && move.BM) ? "x" : "-") << move.end + 1;
+        return ss.str();
+    }
+
+    // Appends the game in m_game_moves, played from m_start_fen, to m_pdn_path
+    void write_pdn() {
+        if(m_pdn_path.empty())
+            return;
+        ofstream pdn_file(m_pdn_path.c_str(), ios::app);
+        if(!pdn_file) {
+            cerr << "Error: Cannot write game record to " << m_pdn_path << endl;
+            return;
+        }
+
+        string winner = winner_string();
+        string result = (winner == "black") ? "1-0" : (winner == "white") ? "0-1" : "1/2-1/2";
+        char date[16];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+
+        pdn_file << "[Event \"CheckersAI game\"]" << endl
+                 << "[Date \"" << date << "\"]" << endl
+                 << "[Black \"" << (BlacK_Player == HUMAN ? "Human" : "CheckersAI") << "\"]" << endl
+                 << "[White \"" << (White_Player == HUMAN ? "Human" : "CheckersAI") << "\"]" << endl
+                 << "[Result \"" << result << "\"]" << endl;
+        if(m_clock.enabled())
+            pdn_file << "[TimeControl \"" << m_clock.time_control() << "\"]" << endl;
+        if(m_start_fen != "B:W21,22,23,24,25,26,27,28,29,30,31,32:B1,2,3,4,5,6,7,8,9,10,11,12")
+            pdn_file << "[FEN \"" << m_start_fen << "\"]" << endl;
+
+        // Move numbers count Black/White pairs, a game started by White opens with "1..."
+        UINT turn = (m_start_fen[0] == 'W') ? WHITE : BLACK;
+        string line;
+        int move_num = 1;
+        for(size_t i = 0; i < m_game_moves.size(); i++) {
+            string token;
+            if(turn == BLACK)
+                token = to_string(move_num) + ". ";
+            else if(i == 0)
+                token = to_string(move_num) + "... ";
+            token += move_to_pdn(m_game_moves[i]);
+            if(turn == WHITE)
+                move_num++;
+            turn ^= 1;
+
+            if(line.size() + token.size() + 1 > 79) {
+                pdn_file << line << endl;
+                line.clear();
+            }
+            line += (line.empty() ? "" : " ") + token;
+        }
+        if(line.size() + result.size() + 1 > 79) {
+            pdn_file << line << endl;
+            line.clear();
+        }
+        pdn_file << line << (line.empty() ? "" : " ") << result << endl << endl;
+    }
+
+
+    //
+    // SETUP_PARAMETERS() AND PLAY()
+    //
+    void setup_parameters() {
+        cpu_time = 0;
+        cpu_timelimit = 0;
+        cpu_maxdepth = 0;
+        root_depth=  0;
+        cpu_time_up = false;
+        m_WP = 0;
+        m_BP = 0;
+        m_K = 0;
+        end_temp = 0;
+        best_move = best_move_temp = Move(0,0,0,0,0);
+        m_moves.clear();
+        m_turn = 0;
+        m_turn_num = 1;
+    }
+
+    int play() {
+        // player inputs and game states
+        int row1, row2;
         char col1, col2;
         UINT start, end;
         char play_again;
 
-        cout << endl;
-        cout << "~~~~~ Welcome to Checkers! ~~~~~" << endl;
-        cout << endl;
+        cout << endl;
+        cout << "~~~~~ Welcome to Checkers! ~~~~~" << endl;
+        cout << endl;
+
+        do {
+            setup_parameters();
+            int mode;
+            char exist_board;
+
+            while(true) {
+                cout << "Game modes available:" << endl
+                  << "1 - Human    VS. Human" << endl
+                  << "2 - Human    VS. Computer" << endl
+                  << "3 - Computer VS. Computer" << endl;
+                cout << "Please select a mode by number: ";
+                if(!(cin >> mode)) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Error: Invalid input, please try again." << endl;
+                }
+                else if(mode != 1 && mode != 2 && mode != 3)
+                    cout << "Error: Please enter 1, 2, or 3." << endl;
+                else {
+                    cout << endl;
+                    break;
+                }
+                cout << endl;
+            }
+
+            switch(mode) {
+                case 1:
+                    White_Player = HUMAN;
+                    BlacK_Player = HUMAN;
+                    break;
+                case 2:
+                    char wb;
+                    while(true) {
+                        cout << "Would you like to play as white or black (w/b)? ";
+                        if(!(cin >> wb)) {
+                            cin.clear();
+                            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                            cout << "Error: Invalid input, please try again." << endl;
+                        }
+                        else if(wb != 'w' && wb != 'b')
+                            cout << "Error: You did not enter w or b." << endl;
+                        else {
+                            cout << endl;
+                            break;
+                        }
+                    }
+                    if(wb == 'w') {
+                        White_Player = HUMAN;
+                        BlacK_Player = COMPUTER;
+                        cout << "You are white. The computer will play as black." << endl;
+                    }
+                    else if(wb == 'b') {
+                        BlacK_Player = HUMAN;
+                        White_Player = COMPUTER;
+                        cout << "You are black. The computer will play as white." << endl;
+                    }
+                    cout << endl;
+                    break;
+                case 3:
+                    White_Player = COMPUTER;
+                    BlacK_Player = COMPUTER;
+                    break;
+            }
+
+
+            while(true) {
+                cout << "Would you like to load an existing board (y/n)? ";
+                if(!(cin >> exist_board)) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Error: Invalid input, please try again." << endl;
+                }
+                else if(exist_board != 'y' && exist_board != 'n')
+                    cout << "Error: You did not enter y or n." << endl;
+                else {
+                    cout << endl;
+                    break;
+                }
+            }
+
+            if(exist_board == 'y')
+                cust_board(m_WP,m_BP,m_K,m_turn,cpu_timelimit);
+
+            else {
+                init_board(m_WP,m_BP,m_K);
+                while(true) {
+                    cout << "Pick starting player (0 for white, 1 for black): ";
+                    if(!(cin >> m_turn)) {
+                        cin.clear();
+                        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                        cout << "Error: Invalid input, please try again." << endl;
+                    }
+                    else if(m_turn != 0 && m_turn != 1)
+                        cout << "Error: You entered an number other than 0 or 1." << endl;
+                    else {
+                        cout << endl;
+                        break;
+                    }
+                }
+
+                //Select CPU time limit, a game clock replaces it
+                if((mode == 2 || mode == 3) && !m_clock.enabled()) {
+                    while(true){
+                        cout << "Designate time limit for CPU (integers only): ";
+                        if (!(cin >> cpu_timelimit)) {
+                            cin.clear();
+                            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                            cout << "Error: Invalid input, please try again." << endl;
+                        }
+                        else if (cpu_timelimit <= 0)
+                            cout << "Error: You entered a negative number" << endl;
+                        else {
+                            cout << endl;
+                            break;
+                        }
+                    }
+                }
+            }
+
+
+            m_start_fen = fen_string();
+            m_game_moves.clear();
+            reset_history();
+            m_clock.reset();
+
+            //Run game
+            while(!is_draw_by_rule() && get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves)) {
+
+                cout << endl << endl;
+                cout << "~~~~~~~~~~~~~~~~~~~~~~" << endl;
+                print_turn_info(m_turn,m_turn_num);
+                cout << "~~~~~~~~~~~~~~~~~~~~~~" << endl;
+
+                m_clock.begin_turn();
+
+                // Player is HUMAN
+                if((m_turn == WHITE && White_Player == HUMAN) || (m_turn == BLACK && BlacK_Player == HUMAN)) {
+
+                    do {
+                        print_legal_moves(m_moves);
+                        cout << endl;
+                        print_board(m_WP,m_BP,m_K);
+                        cout << endl;
+
+                        while(cout << "Specify move <from> <to> (ex. '6e 5f'): " && !(cin >> row1 >> col1 >> row2 >> col2)) {
+                            cin.clear(); //clear bad input flag
+                            cin.ignore(numeric_limits<streamsize>::max(), '\n'); //discard input
+                            cout << "Error: Invalid input, please try again." << endl;
+                        }
+
+                        start = coord_to_bitnum(row1,col1);
+                        end = coord_to_bitnum(row2,col2);
+                    } while(!player_move(start,end));
+                }
+
+                // Player is COMPUTER
+                else {
+                    print_legal_moves(m_moves);
+                    cout << endl;
+                    print_board(m_WP,m_BP,m_K);
+                    cout << endl;
+
+                    clock_t t1, t2, t1_m, t2_m;
+                    cout << "Computer is thinking..." << endl;
+
+                    t1_m = clock();
+                    computer_move(m_turn == WHITE ? true : false);
+                    t2_m = clock();
+
+                    cpu_time = double(t2_m-t1_m)/CLOCKS_PER_SEC;
+                    print_cpu_stats();
+                }
+
+                // The mover's clock runs until the move is made
+                if(m_clock.enabled() && !m_clock.end_turn(m_turn))
+                    m_time_loser = m_turn;
+
+                m_turn ^= 1;
+                m_turn_num++;
+                push_history(m_game_moves.back());
+                if(m_time_loser >= 0)
+                    break;
+            }
+
+            //Display winner
+            cout << endl << endl;
+            print_board(m_WP,m_BP,m_K);
+            cout << endl;
+            cout << "+~+~+~+~+~+~+~+~+~+~+~+~+~+~+" << endl;
+            if(m_time_loser >= 0)
+                cout << (m_time_loser == WHITE ? "White ran out of time. BLACK WINS!" : "Black ran out of time. WHITE WINS!") << endl;
+            else if(!m_draw_reason.empty())
+                cout << "Draw by " << m_draw_reason << ". DRAW!" << endl;
+            else
+                print_winner(m_turn);
+            write_pdn();
+
+            //Prompt to play again
+            while(true) {
+                cout << "Play again (y/n)? ";
+                if(!(cin >> play_again)) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Error: Invalid input, please try again." << endl;
+                }
+                else if(play_again != 'y' && play_again != 'n')
+                    cout << "Error: You did not enter y or n." << endl;
+                else {
+                    cout << endl;
+                    break;
+                }
+            }
+        } while(play_again == 'y');
+
+        return 0;
+    }
+};
+
+
+//
+// PARALLEL SEARCH (YOUNG BROTHERS WAIT)
+//
+// Tree splitting search for analysis. At each node the eldest child is searched first by the
+// thread that owns the node; only then do the remaining siblings become tasks on the owner's
+// deque, where idle threads steal them from the front while the owner pops from the back.
+// A sibling that produces a cutoff marks its split point so every search still running below
+// it returns at its next node. Each thread has its own Game for move generation and evaluation,
+// and all share the process wide trans_table unless it is turned off.
+//
+#define YBWC_MIN_SPLIT_DEPTH 3
+
+class YbwcSearch {
+
+    struct SplitPoint {
+        SplitPoint *parent;
+        bool is_max_node;
+        int depth;
+        UINT WP, BP, K;
+        vector<Game::Move> *moves;
+
+        // Window and best child so far, guarded by lock
+        mutex lock;
+        int min, max;
+        int best;
+        atomic<int> pending;
+        atomic<bool> cutoff;
+    };
+
+    struct Task {
+        SplitPoint *sp;
+        int index;
+    };
+
+    struct Worker {
+        Game engine;
+        thread th;
+        mutex deque_mutex;
+        deque<Task> tasks;
+        UINT seed;
+
+        // Per iteration statistics, busy_ns is the time spent in tasks (all of it for the
+        // master) and split_ns the part of that spent setting up splits or waiting on siblings
+        UINT64 nodes, splits, tasks_run, steals;
+        long long busy_ns, split_ns;
+        int task_depth;
+    };
+
+    vector<unique_ptr<Worker> > workers;
+    atomic<bool> quit, searching, stop;
+    long long deadline;
+    bool use_tt;
+
+    static long long now_ns() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool aborted(SplitPoint *sp) {
+        if(stop.load(memory_order_relaxed))
+            return true;
+        for(; sp; sp = sp->parent)
+            if(sp->cutoff.load(memory_order_relaxed))
+                return true;
+        return false;
+    }
+
+    bool pop_task(Worker &w, Task &task) {
+        lock_guard<mutex> lock(w.deque_mutex);
+        if(w.tasks.empty())
+            return false;
+        task = w.tasks.back();
+        w.tasks.pop_back();
+        return true;
+    }
+
+    // Takes the oldest task of a random other thread, those are the biggest subtrees
+    bool steal_task(int wid, Task &task) {
+        Worker &w = *workers[wid];
+        int n = workers.size();
+        w.seed = w.seed * 1103515245 + 12345;
+        int first = (w.seed >> 16) % n;
+        for(int i = 0; i < n; i++) {
+            int victim = (first + i) % n;
+            if(victim == wid)
+                continue;
+            Worker &v = *workers[victim];
+            lock_guard<mutex> lock(v.deque_mutex);
+            if(!v.tasks.empty()) {
+                task = v.tasks.front();
+                v.tasks.pop_front();
+                w.steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run_task(int wid, const Task &task) {
+        Worker &w = *workers[wid];
+        SplitPoint *sp = task.sp;
+        long long t1 = now_ns();
+        w.task_depth++;
+        if(!aborted(sp)) {
+            int min, max;
+            {
+                lock_guard<mutex> lock(sp->lock);
+                min = sp->min;
+                max = sp->max;
+            }
+            const Game::Move &move = (*sp->moves)[task.index];
+            int value = search_node(wid, !sp->is_max_node, sp->depth - 1, min, max,
+                                    sp->WP ^ move.WM, sp->BP ^ move.BM, sp->K ^ move.KM, sp, 1, NULL);
+
+            // A value from a search that was cut short is meaningless
+            lock_guard<mutex> lock(sp->lock);
+            if(!aborted(sp)) {
+                if(sp->is_max_node && value > sp->min) {
+                    sp->min = value;
+                    sp->best = task.index;
+                }
+                else if(!sp->is_max_node && value < sp->max) {
+                    sp->max = value;
+                    sp->best = task.index;
+                }
+                if(sp->min >= sp->max)
+                    sp->cutoff = true;
+            }
+        }
+        w.tasks_run++;
+        if(--w.task_depth == 0)
+            w.busy_ns += now_ns() - t1;
+        sp->pending.fetch_sub(1, memory_order_release);
+    }
+
+    void worker_loop(int wid) {
+        int idle = 0;
+        workers[wid]->engine.use_eval_cache();
+        while(!quit) {
+            Task task;
+            if(searching && steal_task(wid, task)) {
+                run_task(wid, task);
+                idle = 0;
+            }
+            else if(++idle < 1000)
+                this_thread::yield();
+            else
+                this_thread::sleep_for(chrono::microseconds(100));
+        }
+    }
+
+    // Same minimax as Game::alpha_beta_minimax(), with sp the nearest enclosing split point
+    // best, if not NULL, receives the index of the best move into moves_out
+    int search_node(int wid, bool is_max_node, int depth, int min, int max, UINT WP, UINT BP, UINT K,
+                    SplitPoint *sp_parent, int ply, vector<Game::Move> *moves_out, int *best_out = NULL) {
+        Worker &w = *workers[wid];
+        w.nodes++;
+        if((w.nodes & 1023) == 0 && deadline && now_ms() >= deadline)
+            stop = true;
+        if(aborted(sp_parent))
+            return is_max_node ? INFTY_P : INFTY_N;
+
+        if(depth == 0)
+            return w.engine.quiescence(is_max_node,min,max,WP,BP,K,0);
+
+        UINT64 key = canonical_key(WP,BP,K,is_max_node ? WHITE : BLACK);
+        TTData tt;
+        bool tt_hit = use_tt && trans_table.probe(key,tt,!is_max_node);
+        if(tt_hit && ply > 0 && tt.depth >= depth) {
+            if(tt.flag == TT_EXACT)
+                return tt.score;
+            if(tt.flag == TT_LOWER && tt.score >= max)
+                return max;
+            if(tt.flag == TT_UPPER && tt.score <= min)
+                return min;
+        }
+
+        vector<Game::Move> local_moves;
+        vector<Game::Move> &moves = moves_out ? *moves_out : local_moves;
+        UINT end_temp;
+        w.engine.get_moves(is_max_node ? WHITE : BLACK, WP, BP, K, end_temp, moves);
+        if(moves.empty())
+            return is_max_node ? INFTY_N + depth : INFTY_P - depth;
+
+        if(tt_hit && tt.has_move) {
+            for(size_t i = 1; i < moves.size(); i++) {
+                if(moves[i] == Game::Move(tt.start,tt.end)) {
+                    swap(moves[0],moves[i]);
+                    break;
+                }
+            }
+        }
+
+        int min_orig = min, max_orig = max;
+        int best = -1;
+        bool cut = false;
+
+        // The eldest brother is always searched alone, the rest serially below the split depth
+        size_t serial = (depth >= YBWC_MIN_SPLIT_DEPTH && workers.size() > 1) ? 1 : moves.size();
+        for(size_t i = 0; i < serial && !cut; i++) {
+            int value = search_node(wid, !is_max_node, depth-1, min, max,
+                                    WP ^ moves[i].WM, BP ^ moves[i].BM, K ^ moves[i].KM, sp_parent, ply + 1, NULL);
+            if(is_max_node && value > min) {
+                min = value;
+                best = i;
+            }
+            else if(!is_max_node && value < max) {
+                max = value;
+                best = i;
+            }
+            cut = min >= max;
+        }
+
+        // Young brothers go on the deque
+        if(!cut && serial < moves.size() && !aborted(sp_parent)) {
+            long long t1 = now_ns();
+            SplitPoint sp;
+            sp.parent = sp_parent;
+            sp.is_max_node = is_max_node;
+            sp.depth = depth;
+            sp.WP = WP;
+            sp.BP = BP;
+            sp.K = K;
+            sp.moves = &moves;
+            sp.min = min;
+            sp.max = max;
+            sp.best = best;
+            sp.pending = moves.size() - serial;
+            sp.cutoff = false;
+            {
+                lock_guard<mutex> lock(w.deque_mutex);
+                for(size_t i = moves.size(); i-- > serial; ) {
+                    Task task = {&sp, (int)i};
+                    w.tasks.push_back(task);
+                }
+            }
+            w.splits++;
+            w.split_ns += now_ns() - t1;
+
+            // Help out until every sibling is done, our own tasks first
+            while(sp.pending.load(memory_order_acquire) > 0) {
+                Task task;
+                if(pop_task(w, task) || steal_task(wid, task))
+                    run_task(wid, task);
+                else {
+                    long long t2 = now_ns();
+                    this_thread::yield();
+                    w.split_ns += now_ns() - t2;
+                }
+            }
+
+            min = sp.min;
+            max = sp.max;
+            best = sp.best;
+            cut = sp.cutoff;
+        }
+
+        if(best_out)
+            *best_out = best;
+
+        if(aborted(sp_parent))
+            return is_max_node ? min : max;
+
+        int value = is_max_node ? min : max;
+        if(use_tt) {
+            int flag = TT_EXACT;
+            if(cut)
+                flag = is_max_node ? TT_LOWER : TT_UPPER;
+            else if(is_max_node && value <= min_orig)
+                flag = TT_UPPER;
+            else if(!is_max_node && value >= max_orig)
+                flag = TT_LOWER;
+            if(best >= 0)
+                trans_table.store(key,value,depth,flag,true,moves[best].start,moves[best].end,!is_max_node);
+            else
+                trans_table.store(key,value,depth,flag,false,0,0,!is_max_node);
+        }
+
+        // Fail hard like alpha_beta_minimax()
+        if(cut)
+            return is_max_node ? max_orig : min_orig;
+        return value;
+    }
+
+public:
+    YbwcSearch(int threads, bool hash) {
+        quit = searching = stop = false;
+        deadline = 0;
+        use_tt = hash;
+        for(int i = 0; i < ::max(threads, 1); i++) {
+            workers.push_back(unique_ptr<Worker>(new Worker()));
+            workers[i]->engine.set_eval_noise(false);
+            workers[i]->seed = i + 1;
+        }
+        for(size_t i = 1; i < workers.size(); i++)
+            workers[i]->th = thread(&YbwcSearch::worker_loop, this, i);
+        if(use_tt && !trans_table.is_allocated())
+            trans_table.resize(TT_DEFAULT_MB);
+    }
+    ~YbwcSearch() {
+        quit = true;
+        for(size_t i = 1; i < workers.size(); i++)
+            workers[i]->th.join();
+    }
+
+    // Iterative deepening from 1 to max_depth, or until time_ms (0 = no limit) runs out
+    // Prints one line per completed depth and the per thread statistics of the last one
+    Game::Move analyze(UINT WP, UINT BP, UINT K, UINT turn, int max_depth, int time_ms) {
+        Game::Move best_move(0,0,0,0,0);
+        vector<Game::Move> root_moves;
+        stop = false;
+        deadline = time_ms ? now_ms() + time_ms : 0;
+        workers[0]->engine.use_eval_cache();
+        if(use_tt)
+            trans_table.new_search();
+
+        long long start = now_ms();
+        for(int depth = 1; depth <= max_depth; depth++) {
+            for(size_t i = 0; i < workers.size(); i++) {
+                Worker &w = *workers[i];
+                w.nodes = w.splits = w.tasks_run = w.steals = 0;
+                w.busy_ns = w.split_ns = 0;
+                w.task_depth = 0;
+            }
+
+            long long t1 = now_ns();
+            searching = true;
+            int best = -1;
+            int score = search_node(0, turn == WHITE, depth, INFTY_N, INFTY_P, WP, BP, K, NULL, 0, &root_moves, &best);
+            searching = false;
+            long long wall_ns = now_ns() - t1;
+            workers[0]->busy_ns = wall_ns;
+
+            if(stop)
+                break;
+            if(root_moves.empty()) {
+                cout << "No legal moves." << endl;
+                break;
+            }
+            if(best >= 0)
+                best_move = root_moves[best];
+
+            UINT64 nodes = 0;
+            for(size_t i = 0; i < workers.size(); i++)
+                nodes += workers[i]->nodes;
+            cout << "depth " << setw(2) << depth << "  score " << setw(11) << score
+                 << "  move " << best_move.start + 1 << "-" << best_move.end + 1
+                 << "  nodes " << nodes << "  ms " << (now_ms() - start) << endl;
+
+            if(depth == max_depth || (deadline && now_ms() >= deadline)) {
+                cout << "thread   nodes        tasks  steals  splits  busy%  split overhead%" << endl;
+                for(size_t i = 0; i < workers.size(); i++) {
+                    Worker &w = *workers[i];
+                    cout << setw(6) << i << "   " << setw(11) << left << w.nodes << right
+                         << setw(6) << w.tasks_run << setw(8) << w.steals << setw(8) << w.splits
+                         << fixed << setprecision(1) << setw(7) << 100.0 * (w.busy_ns - w.split_ns) / wall_ns
+                         << setw(10) << 100.0 * w.split_ns / wall_ns << endl;
+                    cout.unsetf(ios::fixed);
+                }
+                break;
+            }
+        }
+        return best_move;
+    }
+};
+
+
+//
+// PROOF-NUMBER SOLVER
+//
+// Depth-first proof-number search (df-pn) that proves or disproves a forced win for the side to
+// move, for puzzles and endgame adjudication. Each node keeps a proof number phi and disproof
+// number delta for its own side to move, where the attacker's goal is a win and the defender's
+// is anything but a loss. So repetitions and the ply limit count against the attacker, and a
+// proof never depends on them. Node values live in a table of their own with a fixed size.
+//
+#define PN_INFINITY 100000000u
+#define PN_DEFAULT_MB 64
+#define PN_LINE_BUDGET 2000000
+
+class PnSolver {
+    // ply is where the values were found, an attacker failure found with fewer plies left
+    // than the current node has may not hold for it
+    struct Entry {
+        UINT64 key;
+        UINT phi, delta;
+        UINT work;
+        int ply;
+    };
+
+    // Buckets of two entries, the one holding less work is replaced
+    vector<Entry> table;
+    UINT64 bucket_mask;
+    Game engine;
+    UINT attacker;
+    int max_ply;
+    UINT64 nodes, node_limit;
+    vector<UINT64> path;
+    unordered_map<UINT64, UINT> distance_memo;
+
+    Entry *lookup(UINT64 key) {
+        Entry *bucket = &table[(key & bucket_mask) * 2];
+        for(int i = 0; i < 2; i++)
+            if(bucket[i].key == key && bucket[i].work)
+                return &bucket[i];
+        return NULL;
+    }
+    void store(UINT64 key, UINT phi, UINT delta, UINT64 work, int ply) {
+        Entry *entry = lookup(key);
+        if(!entry) {
+            Entry *bucket = &table[(key & bucket_mask) * 2];
+            entry = (bucket[0].work <= bucket[1].work) ? &bucket[0] : &bucket[1];
+        }
+        entry->key = key;
+        entry->phi = phi;
+        entry->delta = delta;
+        entry->work = ::max(::min(work, (UINT64)numeric_limits<UINT>::max()), (UINT64)1);
+        entry->ply = ply;
+    }
+
+    // Value of a node that is not searched further: repeated, past the ply limit, or not seen yet
+    void node_value(UINT64 key, UINT turn, int ply, UINT &phi, UINT &delta) {
+        bool cut = ply > max_ply || find(path.begin(), path.end(), key) != path.end();
+        if(cut) {
+            phi = (turn == attacker) ? PN_INFINITY : 0;
+            delta = (turn == attacker) ? 0 : PN_INFINITY;
+            return;
+        }
+        Entry *entry = lookup(key);
+        bool failed = entry && ((turn == attacker) ? entry->delta == 0 : entry->phi == 0);
+        if(!entry || (failed && entry->ply > ply)) {
+            phi = delta = 1;
+            return;
+        }
+        phi = entry->phi;
+        delta = entry->delta;
+    }
+
+    // Multiple iterative deepening: search below the node until phi >= th_phi or delta >= th_delta
+    void mid(UINT WP, UINT BP, UINT K, UINT turn, UINT64 key, int ply, UINT th_phi, UINT th_delta) {
+        UINT64 start_nodes = nodes++;
+        vector<Game::Move> moves;
+        UINT end;
+        engine.get_moves(turn, WP, BP, K, end, moves);
+        if(moves.empty()) {
+            store(key, PN_INFINITY, 0, 1, ply);
+            return;
+        }
+        int n = moves.size();
+        vector<UINT64> keys(n);
+        for(int i = 0; i < n; i++)
+            keys[i] = hash_position(WP ^ moves[i].WM, BP ^ moves[i].BM, K ^ moves[i].KM, !turn);
+
+        path.push_back(key);
+        while(true) {
+            // phi is the smallest child delta and delta the sum of the child phis. Only a proven
+            // child makes the sum infinite, a large one stops just short so it is not taken for a disproof
+            UINT64 delta = 0;
+            UINT phi = PN_INFINITY, second = PN_INFINITY, best_phi = 0;
+            int best = 0;
+            for(int i = 0; i < n; i++) {
+                UINT child_phi, child_delta;
+                node_value(keys[i], !turn, ply + 1, child_phi, child_delta);
+                if(child_phi == PN_INFINITY)
+                    delta = PN_INFINITY;
+                else if(delta < PN_INFINITY)
+                    delta = ::min(delta + child_phi, (UINT64)PN_INFINITY - 1);
+                if(child_delta < phi) {
+                    second = phi;
+                    phi = child_delta;
+                    best = i;
+                    best_phi = child_phi;
+                }
+                else if(child_delta < second)
+                    second = child_delta;
+            }
+            if(phi >= th_phi || delta >= th_delta || nodes >= node_limit) {
+                store(key, phi, delta, nodes - start_nodes, ply);
+                break;
+            }
+            UINT child_th_phi = ::min((UINT64)th_delta - delta + best_phi, (UINT64)PN_INFINITY);
+            UINT child_th_delta = ::min((UINT64)th_phi, (UINT64)second + second / 4 + 1);
+            const Game::Move &move = moves[best];
+            mid(WP ^ move.WM, BP ^ move.BM, K ^ move.KM, !turn, keys[best], ply + 1, child_th_phi, child_th_delta);
+        }
+        path.pop_back();
+    }
+
+    // Whether the proof in the table wins for the attacker within plies. distance_memo keeps
+    // the fewest plies known to win (low 16 bits) and the most known not to (high 16 bits, +1)
+    bool win_within(UINT WP, UINT BP, UINT K, UINT turn, int plies, UINT64 &budget) {
+        UINT64 key = hash_position(WP, BP, K, turn);
+        unordered_map<UINT64, UINT>::iterator memo = distance_memo.find(key);
+        if(memo != distance_memo.end()) {
+            if(plies >= (int)(memo->second & 0xFFFF))
+                return true;
+            if(plies < (int)(memo->second >> 16))
+                return false;
+        }
+        if(budget == 0)
+            return false;
+        budget--;
+
+        vector<Game::Move> moves;
+        UINT end;
+        engine.get_moves(turn, WP, BP, K, end, moves);
+        bool won = moves.empty() ? turn != attacker : plies > 0 && turn != attacker;
+        for(size_t i = 0; i < moves.size() && plies > 0; i++) {
+            UINT WP_next = WP ^ moves[i].WM, BP_next = BP ^ moves[i].BM, K_next = K ^ moves[i].KM;
+            Entry *child = lookup(hash_position(WP_next, BP_next, K_next, !turn));
+            bool proven = child && (turn != attacker ? child->phi == 0 : child->delta == 0);
+            bool child_won = proven && win_within(WP_next, BP_next, K_next, !turn, plies - 1, budget);
+            if(turn == attacker && child_won) {
+                won = true;
+                break;
+            }
+            if(turn != attacker && !child_won) {
+                won = false;
+                break;
+            }
+        }
+
+        UINT &entry = distance_memo.insert(make_pair(key, 0xFFFFu)).first->second;
+        if(won)
+            entry = (entry & 0xFFFF0000u) | ::min((UINT)plies, entry & 0xFFFF);
+        else if(budget)
+            entry = (::max((UINT)plies + 1, entry >> 16) << 16) | (entry & 0xFFFF);
+        return won;
+    }
+    int win_distance(UINT WP, UINT BP, UINT K, UINT turn, UINT64 &budget) {
+        for(int plies = 0; plies <= max_ply && budget; plies++)
+            if(win_within(WP, BP, K, turn, plies, budget))
+                return plies;
+        return -1;
+    }
+
+public:
+    PnSolver(size_t mb, int max_ply, UINT64 node_limit) {
+        size_t buckets = 1;
+        while(buckets * 2 * 2 * sizeof(Entry) <= mb * 1024 * 1024)
+            buckets *= 2;
+        table.assign(buckets * 2, Entry());
+        bucket_mask = buckets - 1;
+        this->max_ply = max_ply;
+        this->node_limit = node_limit ? node_limit : numeric_limits<UINT64>::max();
+        nodes = 0;
+        engine.set_eval_noise(false);
+    }
+
+    UINT64 get_nodes() { return nodes; }
+
+    // 1 = forced win, 0 = no forced win within max_ply plies, -1 = node limit reached
+    // For a win, line receives the shortest win the table proves against the longest defence
+    int solve(UINT WP, UINT BP, UINT K, UINT turn, vector<Game::Move> &line) {
+        attacker = turn;
+        nodes = 0;
+        path.clear();
+        line.clear();
+        UINT64 key = hash_position(WP, BP, K, turn);
+        mid(WP, BP, K, turn, key, 0, PN_INFINITY, PN_INFINITY);
+        Entry *root = lookup(key);
+        if(!root || (root->phi != 0 && root->delta != 0))
+            return -1;
+        if(root->delta == 0)
+            return 0;
+
+        // Shortest win along the proof, the defender taking the longest resistance
+        UINT64 budget = PN_LINE_BUDGET;
+        distance_memo.clear();
+        int distance = win_distance(WP, BP, K, turn, budget);
+        for(; distance > 0; distance--, turn = !turn) {
+            vector<Game::Move> moves;
+            UINT end;
+            engine.get_moves(turn, WP, BP, K, end, moves);
+            int pick = -1;
+            for(size_t i = 0; i < moves.size() && pick < 0; i++) {
+                UINT WP_next = WP ^ moves[i].WM, BP_next = BP ^ moves[i].BM, K_next = K ^ moves[i].KM;
+                if(turn == attacker ? win_within(WP_next, BP_next, K_next, !turn, distance - 1, budget)
+                                    : distance < 2 || !win_within(WP_next, BP_next, K_next, !turn, distance - 2, budget))
+                    pick = (int)i;
+            }
+            if(pick < 0)
+                break;
+            line.push_back(moves[pick]);
+            WP ^= moves[pick].WM;
+            BP ^= moves[pick].BM;
+            K ^= moves[pick].KM;
+        }
+        return 1;
+    }
+};
+
+
+//
+// MONTE CARLO TREE SEARCH
+//
+// PUCT search as an alternative to itr_deepening(). A leaf is valued by quiescence(), mapped to
+// a win probability with sigmoid(score / MCTS_EVAL_SCALE), and its moves get priors from a
+// softmax over heuristics_batch() of the positions they lead to. Nodes come from an arena and
+// the children of a node sit next to each other in it. A node's value is kept for the side that
+// moved into it. Threads walk the tree at once, each adding a virtual loss on its way down so the
+// others spread out. The search stops early once the arena has no room for another expansion.
+// Searching a position within two plies of the last root carries the subtree below it over,
+// copied to the front of the spare arena.
+//
+#define MCTS_DEFAULT_MB 256
+#define MCTS_SERVER_MB 16
+// heuristics() scales every weight by 1e4, so this makes a pawn worth sigmoid(1) = 0.73
+#define MCTS_EVAL_SCALE (1e4 * W_PAWN)
+#define MCTS_PRIOR_TEMP 0.1
+#define MCTS_C_PUCT 1.5
+#define MCTS_FPU_REDUCTION 0.1
+#define MCTS_VIRTUAL_LOSS 3
+#define MCTS_VALUE_ONE 65536
+
+class MctsSearch {
+
+    struct Node {
+        UINT WP, BP, K;
+        unsigned char start, end, turn;
+        atomic<unsigned char> state;
+        float prior;
+        UINT first_child, num_children;
+        atomic<int> visits;
+        atomic<long long> value;  // sum of results in 1/MCTS_VALUE_ONE wins
+    };
+    enum { UNEXPANDED, EXPANDING, EXPANDED, TERMINAL };
+
+    struct Worker {
+        Game engine;
+        vector<Game::Move> moves;
+        vector<UINT> path;
+    };
+
+    unique_ptr<Node[]> pools[2];
+    Node *pool;
+    UINT capacity;
+    atomic<UINT> used;
+    vector<unique_ptr<Worker> > workers;
+    atomic<bool> stop, full;
+    long long deadline;
+    UINT64 playout_limit;
+    atomic<UINT64> playouts;
+    UINT64 reused;
+
+    void init_node(Node &node, UINT WP, UINT BP, UINT K, UINT turn, UINT start, UINT end, float prior) {
+        node.WP = WP;
+        node.BP = BP;
+        node.K = K;
+        node.turn = turn;
+        node.start = start;
+        node.end = end;
+        node.prior = prior;
+        node.first_child = node.num_children = 0;
+        node.state.store(UNEXPANDED, memory_order_relaxed);
+        node.visits.store(0, memory_order_relaxed);
+        node.value.store(0, memory_order_relaxed);
+    }
+
+    // Win probability of the side that moved into node
+    double leaf_value(Worker &w, const Node &node) {
+        int score = w.engine.quiescence(node.turn == WHITE, INFTY_N, INFTY_P, node.WP, node.BP, node.K, 0);
+        double white = 1.0 / (1.0 + exp(-score / MCTS_EVAL_SCALE));
+        return node.turn == WHITE ? 1.0 - white : white;
+    }
+
+    // Gives node its children, false if the arena is full
+    bool expand(Worker &w, Node &node) {
+        UINT end;
+        w.engine.get_moves(node.turn, node.WP, node.BP, node.K, end, w.moves);
+        int n = w.moves.size();
+        if(n == 0) {
+            node.state.store(TERMINAL, memory_order_release);
+            return true;
+        }
+        UINT first = capacity;
+        if(used.load(memory_order_relaxed) + n <= capacity)
+            first = used.fetch_add(n, memory_order_relaxed);
+        if(first + (UINT64)n > capacity) {
+            node.state.store(UNEXPANDED, memory_order_release);
+            full = stop = true;
+            return false;
+        }
+
+        UINT WP[BATCH_MAX_MOVES], BP[BATCH_MAX_MOVES], K[BATCH_MAX_MOVES];
+        int scores[BATCH_MAX_MOVES];
+        double best = 0, sum = 0;
+        for(int i = 0; i < n; i += BATCH_MAX_MOVES) {
+            int m = ::min(n - i, BATCH_MAX_MOVES);
+            for(int j = 0; j < m; j++) {
+                WP[j] = node.WP ^ w.moves[i+j].WM;
+                BP[j] = node.BP ^ w.moves[i+j].BM;
+                K[j] = node.K ^ w.moves[i+j].KM;
+            }
+            w.engine.heuristics_batch(WP, BP, K, m, scores);
+            for(int j = 0; j < m; j++) {
+                double white = 1.0 / (1.0 + exp(-scores[j] / MCTS_EVAL_SCALE));
+                double win = node.turn == WHITE ? white : 1.0 - white;
+                best = ::max(best, win);
+                init_node(pool[first+i+j], WP[j], BP[j], K[j], !node.turn, w.moves[i+j].start, w.moves[i+j].end, win);
+            }
+        }
+        // Softmax of the win probabilities
+        for(int i = 0; i < n; i++)
+            sum += pool[first+i].prior = exp((pool[first+i].prior - best) / MCTS_PRIOR_TEMP);
+        for(int i = 0; i < n; i++)
+            pool[first+i].prior /= sum;
+        node.first_child = first;
+        node.num_children = n;
+        node.state.store(EXPANDED, memory_order_release);
+        return true;
+    }
+
+    // Child of parent with the highest Q + U, children not visited yet taking the parent's Q
+    // less MCTS_FPU_REDUCTION
+    UINT select_child(const Node &parent) {
+        int parent_visits = parent.visits.load(memory_order_relaxed);
+        double fpu = parent_visits ? 1.0 - double(parent.value.load(memory_order_relaxed)) / MCTS_VALUE_ONE / parent_visits : 0.5;
+        fpu -= MCTS_FPU_REDUCTION;
+        double explore = MCTS_C_PUCT * sqrt(double(::max(parent_visits, 1)));
+        UINT best = parent.first_child;
+        double best_score = -1e300;
+        for(UINT i = parent.first_child; i < parent.first_child + parent.num_children; i++) {
+            const Node &child = pool[i];
+            int visits = child.visits.load(memory_order_relaxed);
+            double q = visits ? double(child.value.load(memory_order_relaxed)) / MCTS_VALUE_ONE / visits : fpu;
+            double score = q + explore * child.prior / (1 + visits);
+            if(score > best_score) {
+                best_score = score;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    void playout(Worker &w) {
+        w.path.clear();
+        UINT index = 0;
+        while(true) {
+            Node &node = pool[index];
+            w.path.push_back(index);
+            node.visits.fetch_add(MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+            if(node.state.load(memory_order_acquire) != EXPANDED)
+                break;
+            index = select_child(node);
+        }
+
+        // A leaf gets its children on its second visit, so the many visited only once take no
+        // room. One being expanded by another thread, or that the arena has no room for, is
+        // valued as a leaf again.
+        Node &leaf = pool[index];
+        unsigned char state = UNEXPANDED;
+        if(leaf.visits.load(memory_order_relaxed) > MCTS_VIRTUAL_LOSS
+           && leaf.state.compare_exchange_strong(state, EXPANDING, memory_order_acquire))
+            expand(w, leaf);
+        double value = leaf.state.load(memory_order_acquire) == TERMINAL ? 1.0 : leaf_value(w, leaf);
+
+        for(int i = w.path.size() - 1; i >= 0; i--) {
+            Node &node = pool[w.path[i]];
+            node.value.fetch_add((long long)(value * MCTS_VALUE_ONE), memory_order_relaxed);
+            node.visits.fetch_add(1 - MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+            value = 1.0 - value;
+        }
+        playouts.fetch_add(1, memory_order_relaxed);
+    }
+
+    void worker_loop(int wid) {
+        Worker &w = *workers[wid];
+        w.engine.use_eval_cache();
+        while(!stop.load(memory_order_relaxed)) {
+            playout(w);
+            if((deadline && now_ms() >= deadline) || (playout_limit && playouts.load(memory_order_relaxed) >= playout_limit))
+                stop = true;
+        }
+    }
+
+    // Copies the subtree under pool[from] to the front of the spare arena, which becomes the
+    // arena. Children stay next to each other, so the copy goes breadth first, and it stops at
+    // half the arena so the search has room to go on. Nodes whose children no longer fit are
+    // left unexpanded.
+    void compact(UINT from) {
+        Node *to = pool == pools[0].get() ? pools[1].get() : pools[0].get();
+        deque<pair<UINT,UINT> > queue;
+        UINT next = 1;
+        auto copy = [&](UINT dst, UINT src) {
+            const Node &s = pool[src];
+            init_node(to[dst], s.WP, s.BP, s.K, s.turn, s.start, s.end, s.prior);
+            to[dst].visits.store(s.visits.load(memory_order_relaxed), memory_order_relaxed);
+            to[dst].value.store(s.value.load(memory_order_relaxed), memory_order_relaxed);
+            unsigned char state = s.state.load(memory_order_relaxed);
+            to[dst].state.store(state == EXPANDING ? (unsigned char)UNEXPANDED : state, memory_order_relaxed);
+            if(state == EXPANDED)
+                queue.push_back(make_pair(dst, src));
+        };
+        copy(0, from);
+        while(!queue.empty()) {
+            UINT dst = queue.front().first, src = queue.front().second;
+            queue.pop_front();
+            if(next + pool[src].num_children > capacity / 2) {
+                to[dst].state.store(UNEXPANDED, memory_order_relaxed);
+                continue;
+            }
+            to[dst].first_child = next;
+            to[dst].num_children = pool[src].num_children;
+            next += pool[src].num_children;
+            for(UINT i = 0; i < pool[src].num_children; i++)
+                copy(to[dst].first_child + i, pool[src].first_child + i);
+        }
+        pool = to;
+        used = next;
+        reused = next - 1;
+    }
+
+    // Makes the position the root, keeping what the tree knows of it
+    void set_root(UINT WP, UINT BP, UINT K, UINT turn) {
+        reused = 0;
+        full = false;
+        if(used > 0) {
+            UINT found = capacity;
+            const Node &root = pool[0];
+            if(root.WP == WP && root.BP == BP && root.K == K && root.turn == turn) {
+                reused = get_nodes_used() - 1;
+                return;
+            }
+            if(root.state.load(memory_order_relaxed) == EXPANDED)
+                for(UINT i = root.first_child; i < root.first_child + root.num_children && found == capacity; i++) {
+                    const Node &child = pool[i];
+                    if(child.WP == WP && child.BP == BP && child.K == K && child.turn == turn)
+                        found = i;
+                    else if(child.state.load(memory_order_relaxed) == EXPANDED)
+                        for(UINT j = child.first_child; j < child.first_child + child.num_children; j++)
+                            if(pool[j].WP == WP && pool[j].BP == BP && pool[j].K == K && pool[j].turn == turn) {
+                                found = j;
+                                break;
+                            }
+                }
+            if(found < capacity) {
+                compact(found);
+                return;
+            }
+        }
+        init_node(pool[0], WP, BP, K, turn, 0, 0, 1);
+        used = 1;
+    }
+
+public:
+    MctsSearch(int threads, size_t mb) : stop(false), full(false), deadline(0), playout_limit(0), playouts(0), reused(0) {
+        capacity = ::max<size_t>(mb * 1024 * 1024 / 2 / sizeof(Node), BATCH_MAX_MOVES + 1);
+        pools[0].reset(new Node[capacity]);
+        pools[1].reset(new Node[capacity]);
+        pool = pools[0].get();
+        used = 0;
+        for(int i = 0; i < ::max(threads, 1); i++) {
+            workers.push_back(unique_ptr<Worker>(new Worker()));
+            workers[i]->engine.set_eval_noise(false);
+        }
+    }
+
+    // Forgets the tree, for a new game
+    void clear() { used = 0; }
+
+    // Searches for time_ms (0 = no limit) or until playout_limit playouts (0 = no limit), at least
+    // one of them set. Returns the most visited move, Move(0,0,0,0,0) if there is none.
+    Game::Move search(UINT WP, UINT BP, UINT K, UINT turn, int time_ms, UINT64 playout_limit) {
+        set_root(WP, BP, K, turn);
+        stop = false;
+        playouts = 0;
+        deadline = time_ms ? now_ms() + time_ms : 0;
+        this->playout_limit = playout_limit;
+
+        vector<Game::Move> &moves = workers[0]->moves;
+        UINT end;
+        workers[0]->engine.get_moves(turn, WP, BP, K, end, moves);
+        if(moves.size() <= 1)
+            return moves.empty() ? Game::Move(0,0,0,0,0) : moves[0];
+
+        vector<thread> helpers;
+        for(int i = 1; i < (int)workers.size(); i++)
+            helpers.push_back(thread(&MctsSearch::worker_loop, this, i));
+        worker_loop(0);
+        for(thread &helper : helpers)
+            helper.join();
+
+        const Node &root = pool[0];
+        UINT best = root.first_child;
+        for(UINT i = root.first_child; i < root.first_child + root.num_children; i++)
+            if(pool[i].visits > pool[best].visits)
+                best = i;
+        workers[0]->engine.get_moves(turn, WP, BP, K, end, moves);
+        for(size_t i = 0; i < moves.size(); i++)
+            if(moves[i].start == pool[best].start && moves[i].end == pool[best].end)
+                return moves[i];
+        return moves[0];
+    }
+
+    UINT64 get_playouts() { return playouts; }
+    UINT64 get_reused() { return reused; }
+    UINT get_nodes_used() { return ::min(used.load(), capacity); }
+    UINT get_capacity() { return capacity; }
+    bool is_full() { return full; }
+    int get_threads() { return workers.size(); }
+
+    // Most visited line from the root, with the root's visit count and win probability for
+    // the side to move
+    string pv_string(int max_moves = 12) {
+        stringstream ss;
+        UINT index = 0;
+        for(int i = 0; i < max_moves && pool[index].state == EXPANDED && pool[index].num_children; i++) {
+            UINT best = pool[index].first_child;
+            for(UINT j = best; j < pool[index].first_child + pool[index].num_children; j++)
+                if(pool[j].visits > pool[best].visits)
+                    best = j;
+            if(pool[best].visits == 0)
+                break;
+            ss << (i ? " " : "") << pool[best].start + 1 << "-" << pool[best].end + 1;
+            index = best;
+        }
+        return ss.str();
+    }
+    double root_value() {
+        int visits = pool[0].visits;
+        return visits ? 1.0 - double(pool[0].value) / MCTS_VALUE_ONE / visits : 0.5;
+    }
+    int root_visits() { return pool[0].visits; }
+};
+
+
+//
+// PDN REPLAY
+//
+// Replays the games of a PDN file through get_moves() and the Move deltas, for rebuilding
+// positions from game archives. Tags other than FEN and Result, comments, variations and
+// move numbers are skipped. Games with an illegal move are counted in bad_games and dropped.
+//
+struct PdnStats {
+    UINT64 games, bad_games, plies;
+};
+
+class PdnReplayer {
+    Game &game;
+    vector<Game::Move> moves;
+
+    // Positions of the game being replayed, handed out once its result is known
+    vector<UINT> positions;
+
+    static bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+    static bool is_token_end(char c) {
+        return is_space(c) || c == '{' || c == '(' || c == ';' || c == '[';
+    }
+
+    // "1-0"/"2-0" Black wins, "0-1"/"0-2" White wins, "1/2-1/2"/"1-1" draw, "*" unknown
+    // Returns -1 if the token is not a result
+    static int parse_result(const char *p, const char *end) {
+        string token(p, end);
+        if(token == "1-0" || token == "2-0")
+            return RESULT_BLACK_WIN;
+        if(token == "0-1" || token == "0-2")
+            return RESULT_WHITE_WIN;
+        if(token == "1/2-1/2" || token == "1-1")
+            return RESULT_DRAW;
+        if(token == "*")
+            return RESULT_UNKNOWN;
+        return -1;
+    }
+
+public:
+    PdnReplayer(Game &g) : game(g) {}
+
+    // Calls f(WP, BP, K, turn, result) for the position before every move of every good game
+    template<typename F>
+    PdnStats replay(const char *p, const char *file_end, F f) {
+        PdnStats stats = {0, 0, 0};
+        UINT WP, BP, K, turn, end_temp;
+        int result = RESULT_UNKNOWN;
+        bool in_game = false, bad = false;
+
+        game.init_board(WP, BP, K);
+        turn = BLACK;
+        positions.clear();
+
+        // Finishes the current game, called at a result token, a new tag section or end of file
+        auto finish_game = [&]() {
+            if(!in_game)
+                return;
+            stats.games++;
+            if(bad)
+                stats.bad_games++;
+            else {
+                stats.plies += positions.size() / 4;
+                for(size_t i = 0; i < positions.size(); i += 4)
+                    f(positions[i], positions[i+1], positions[i+2], positions[i+3], (UINT)result);
+            }
+            in_game = bad = false;
+            result = RESULT_UNKNOWN;
+            game.init_board(WP, BP, K);
+            turn = BLACK;
+            positions.clear();
+        };
+
+        bool in_moves = false;
+        while(p < file_end) {
+            char c = *p;
+            if(is_space(c)) {
+                p++;
+                continue;
+            }
+
+            // Tag pair, a tag after movetext starts a new game
+            if(c == '[') {
+                if(in_moves) {
+                    finish_game();
+                    in_moves = false;
+                }
+                in_game = true;
+                const char *name = ++p;
+                while(p < file_end && !is_space(*p) && *p != ']')
+                    p++;
+                const char *name_end = p;
+                while(p < file_end && *p != '"' && *p != ']')
+                    p++;
+                const char *value = (p < file_end && *p == '"') ? ++p : p;
+                while(p < file_end && *p != '"' && *p != ']')
+                    p++;
+                const char *value_end = p;
+                while(p < file_end && *p != ']')
+                    p++;
+                p++;
+
+                if(name_end - name == 3 && memcmp(name, "FEN", 3) == 0) {
+                    if(!parse_fen(value, value_end, WP, BP, K, turn))
+                        bad = true;
+                }
+                else if(name_end - name == 6 && memcmp(name, "Result", 6) == 0) {
+                    int r = parse_result(value, value_end);
+                    if(r >= 0)
+                        result = r;
+                }
+                continue;
+            }
+
+            // Comments and variations
+            if(c == '{') {
+                while(p < file_end && *p != '}')
+                    p++;
+                p++;
+                continue;
+            }
+            if(c == '(') {
+                int nesting = 0;
+                do {
+                    if(*p == '(')
+                        nesting++;
+                    else if(*p == ')')
+                        nesting--;
+                    p++;
+                } while(p < file_end && nesting > 0);
+                continue;
+            }
+            if(c == ';') {
+                while(p < file_end && *p != '\n')
+                    p++;
+                continue;
+            }
+
+            const char *token = p;
+            while(p < file_end && !is_token_end(*p))
+                p++;
+            const char *token_end = p;
+            in_moves = in_game = true;
+
+            int r = parse_result(token, token_end);
+            if(r >= 0) {
+                if(r != RESULT_UNKNOWN || result == RESULT_UNKNOWN)
+                    result = r;
+                finish_game();
+                in_moves = false;
+                continue;
+            }
+
+            // Move numbers, possibly glued to the move as in "1.11-15"
+            const char *q = token;
+            while(q < token_end && *q >= '0' && *q <= '9')
+                q++;
+            if(q < token_end && *q == '.') {
+                while(q < token_end && *q == '.')
+                    q++;
+                token = q;
+                if(token == token_end)
+                    continue;
+            }
+            if(bad)
+                continue;
+
+            // Move "11-15", "22x15" or "1x10x19", only the first and last squares matter
+            UINT first = 0, last = 0, n = 0;
+            q = token;
+            while(q < token_end) {
+                UINT sq = 0;
+                const char *digits = q;
+                while(q < token_end && *q >= '0' && *q <= '9')
+                    sq = sq * 10 + (*q++ - '0');
+                if(q == digits || sq < 1 || sq > 32)
+                    break;
+                if(n++ == 0)
+                    first = sq;
+                last = sq;
+                if(q < token_end && (*q == '-' || *q == 'x' || *q == 'X' || *q == ':'))
+                    q++;
+                else
+                    break;
+            }
+            // Ignore trailing annotations like "!" or "?"
+            while(q < token_end && (*q == '!' || *q == '?'))
+                q++;
+            if(n < 2 || q != token_end) {
+                bad = true;
+                continue;
+            }
+
+            Game::Move *move = NULL;
+            game.get_moves(turn, WP, BP, K, end_temp, moves);
+            for(size_t i = 0; i < moves.size(); i++) {
+                if(moves[i].start == first - 1 && moves[i].end == last - 1) {
+                    move = &moves[i];
+                    break;
+                }
+            }
+            if(!move) {
+                bad = true;
+                continue;
+            }
+
+            positions.push_back(WP);
+            positions.push_back(BP);
+            positions.push_back(K);
+            positions.push_back(turn);
+            WP ^= move->WM;
+            BP ^= move->BM;
+            K ^= move->KM;
+            turn ^= 1;
+        }
+        finish_game();
+        return stats;
+    }
+};
+
+
+//
+// EVALUATION TUNING
+//
+// Texel style tuning of the CheckersWeights.h multipliers against game results. Every quiet
+// position (side to move has no jump) of a labelled position file is reduced once to its
+// heuristics() terms, after which an epoch is just a multi-threaded pass of dot products.
+// The predicted score of a position is sigmoid(k * eval), with k fitted first, and the squared
+// error against the result (1 white win, 0.5 draw, 0 black win) is minimised with Adam.
+// W_PAWN stays fixed since only the ratios between weights matter.
+//
+class Tuner {
+    int num_threads;
+    vector<signed char> terms;
+    vector<float> results;
+    double weights[NUM_EVAL_TERMS];
+    double k;
+
+    static double sigmoid(double x) {
+        return 1.0 / (1.0 + exp(-x));
+    }
+
+    // Runs f(thread, first, last) over the positions split evenly across the threads
+    template<typename F>
+    void parallel_for(size_t n, F f) {
+        vector<thread> threads;
+        size_t chunk = (n + num_threads - 1) / num_threads;
+        for(int t = 0; t < num_threads; t++) {
+            size_t first = t * chunk, last = ::min(n, first + chunk);
+            if(first < last)
+                threads.push_back(thread(f, t, first, last));
+        }
+        for(size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+    double eval(size_t i, const double *w) {
+        const signed char *f = &terms[i * NUM_EVAL_TERMS];
+        double e = 0;
+        for(int j = 0; j < NUM_EVAL_TERMS; j++)
+            e += w[j] * f[j];
+        return e;
+    }
+
+    // Mean squared error, and its gradient if grad is not NULL
+    double error(const double *w, double scale, double *grad) {
+        size_t n = results.size();
+        vector<double> sums(num_threads, 0.0);
+        vector<double> grads(num_threads * NUM_EVAL_TERMS, 0.0);
+        parallel_for(n, [&](int t, size_t first, size_t last) {
+            double sum = 0;
+            double g[NUM_EVAL_TERMS] = {0};
+            for(size_t i = first; i < last; i++) {
+                double p = sigmoid(scale * eval(i, w));
+                double d = p - results[i];
+                sum += d * d;
+                if(grad) {
+                    double common = 2 * d * p * (1 - p) * scale;
+                    const signed char *f = &terms[i * NUM_EVAL_TERMS];
+                    for(int j = 0; j < NUM_EVAL_TERMS; j++)
+                        g[j] += common * f[j];
+                }
+            }
+            sums[t] = sum;
+            for(int j = 0; j < NUM_EVAL_TERMS; j++)
+                grads[t * NUM_EVAL_TERMS + j] = g[j];
+        });
+
+        double total = 0;
+        for(int t = 0; t < num_threads; t++)
+            total += sums[t];
+        if(grad) {
+            for(int j = 0; j < NUM_EVAL_TERMS; j++) {
+                grad[j] = 0;
+                for(int t = 0; t < num_threads; t++)
+                    grad[j] += grads[t * NUM_EVAL_TERMS + j];
+                grad[j] /= n;
+            }
+        }
+        return total / n;
+    }
+
+public:
+    Tuner(int threads) {
+        num_threads = ::max(threads, 1);
+        for(int j = 0; j < NUM_EVAL_TERMS; j++)
+            weights[j] = EVAL_WEIGHTS[j];
+        k = 0;
+    }
+
+    // Loads the labelled, quiet positions, returns how many were kept
+    size_t load(const PositionFile &file) {
+        vector<Game> games(num_threads);
+        terms.clear();
+        results.clear();
+
+        // Binary records are split across the threads, FEN text carries no results
+        size_t n = file.num_records();
+        vector<vector<signed char> > part_terms(num_threads);
+        vector<vector<float> > part_results(num_threads);
+        parallel_for(n, [&](int t, size_t first, size_t last) {
+            Game &game = games[t];
+            UINT WP, BP, K, turn, result;
+            int f[NUM_EVAL_TERMS];
+            for(size_t i = first; i < last; i++) {
+                decode_record(file.record(i), WP, BP, K, turn, result);
+                if(result == RESULT_UNKNOWN || !WP || !BP)
+                    continue;
+                if(turn == WHITE ? game.get_jumpers_W(WP,BP,K) : game.get_jumpers_B(WP,BP,K))
+                    continue;
+                game.eval_features(WP, BP, K, f);
+                for(int j = 0; j < NUM_EVAL_TERMS; j++)
+                    part_terms[t].push_back(f[j]);
+                part_results[t].push_back(result == RESULT_WHITE_WIN ? 1.0f : result == RESULT_DRAW ? 0.5f : 0.0f);
+            }
+        });
+        for(int t = 0; t < num_threads; t++) {
+            terms.insert(terms.end(), part_terms[t].begin(), part_terms[t].end());
+            results.insert(results.end(), part_results[t].begin(), part_results[t].end());
+        }
+        return results.size();
+    }
+
+    // Golden section search for the k that fits the current weights best, on a log scale
+    double fit_scale() {
+        double lo = log(1e-7), hi = log(1e-1);
+        const double ratio = (sqrt(5.0) - 1) / 2;
+        double a = hi - ratio * (hi - lo), b = lo + ratio * (hi - lo);
+        double fa = error(weights, exp(a), NULL), fb = error(weights, exp(b), NULL);
+        for(int i = 0; i < 60; i++) {
+            if(fa < fb) {
+                hi = b;
+                b = a;
+                fb = fa;
+                a = hi - ratio * (hi - lo);
+                fa = error(weights, exp(a), NULL);
+            }
+            else {
+                lo = a;
+                a = b;
+                fa = fb;
+                b = lo + ratio * (hi - lo);
+                fb = error(weights, exp(b), NULL);
+            }
+        }
+        k = exp((lo + hi) / 2);
+        return error(weights, k, NULL);
+    }
+
+    // Adam, step sizes are in weight units; returns the final error
+    double optimize(int epochs, double rate) {
+        double m[NUM_EVAL_TERMS] = {0}, v[NUM_EVAL_TERMS] = {0}, grad[NUM_EVAL_TERMS];
+        const double beta1 = 0.9, beta2 = 0.999;
+        for(int epoch = 1; epoch <= epochs; epoch++) {
+            long long t1 = now_ms();
+            double e = error(weights, k, grad);
+            for(int j = 1; j < NUM_EVAL_TERMS; j++) {
+                m[j] = beta1 * m[j] + (1 - beta1) * grad[j];
+                v[j] = beta2 * v[j] + (1 - beta2) * grad[j] * grad[j];
+                double m_hat = m[j] / (1 - pow(beta1, epoch));
+                double v_hat = v[j] / (1 - pow(beta2, epoch));
+                weights[j] -= rate * m_hat / (sqrt(v_hat) + 1e-12);
+                if(weights[j] < 0)
+                    weights[j] = 0;
+            }
+            if(epoch == 1 || epoch % 50 == 0 || epoch == epochs)
+                cout << "epoch " << setw(4) << epoch << "  error " << fixed << setprecision(6) << e
+                     << "  (" << (now_ms() - t1) << " ms)" << endl;
+        }
+        cout.unsetf(ios::fixed);
+        return error(weights, k, NULL);
+    }
+
+    bool write_header(const string &path, double error_before, double error_after) {
+        ofstream out(path.c_str());
+        if(!out)
+            return false;
+        out << "//" << endl
+            << "// CheckersWeights.h" << endl
+            << "// Multipliers of offset in Game::heuristics()" << endl
+            << "// Written by 'CheckersAI tune', rebuild the engine after regenerating" << endl
+            << "// Tuned on " << results.size() << " positions, error " << fixed << setprecision(6)
+            << error_before << " -> " << error_after << endl
+            << "//" << endl << endl
+            << "#ifndef CHECKERSWEIGHTS_H" << endl
+            << "#define CHECKERSWEIGHTS_H" << endl << endl;
+        for(int j = 0; j < NUM_EVAL_TERMS; j++) {
+            string decl = string("constexpr int ") + EVAL_TERM_NAMES[j] + " = " + to_string((int)lround(weights[j])) + ";";
+            out << left << setw(39) << decl << "// " << EVAL_TERM_NOTES[j] << endl;
+        }
+        out << endl << "#endif" << endl;
+        return true;
+    }
+
+    void print_weights() {
+        for(int j = 0; j < NUM_EVAL_TERMS; j++)
+            cout << "  " << left << setw(16) << EVAL_TERM_NAMES[j] << right << setw(6) << EVAL_WEIGHTS[j]
+                 << " -> " << lround(weights[j]) << endl;
+    }
+};
+
+
+//
+// SELF-PLAY DATA
+//
+// Plays fixed node searches against themselves from random openings and writes every searched
+// position with its score, best move and the final result as a self-play stream (see POSITION
+// FORMATS). Game g of n goes to shard g % shards, file <prefix>.<shard>.sp, and is played from
+// a seed made of g, so a shard interrupted at any point is resumed by cutting it back to its
+// last whole block and playing on from the next game. Threads each take whole shards.
+//
+#define SP_BLOCK_GAMES 16
+#define SP_DEFAULT_NODES 5000
+#define SP_MAX_PLIES 300
+
+class SelfPlay {
+    UINT64 games, node_limit, seed;
+    int shards, random_plies;
+    bool compress;
+    atomic<int> next_shard;
+    atomic<UINT64> games_played, positions_written;
+    mutex report_mutex;
+
+    // Appends one block of games to out, false if the write failed
+    bool write_block(FILE *out, const vector<unsigned char> &raw, UINT block_games) {
+        unsigned char header[SP_HEADER_SIZE];
+        vector<unsigned char> coded;
+        const unsigned char *payload = raw.data();
+        UINT payload_size = raw.size();
+        if(compress) {
+            coded.resize(raw.size() + raw.size() / 128 + 1);
+            payload_size = sp_compress(raw.data(), raw.size(), coded.data());
+            payload = coded.data();
+        }
+        memcpy(header, SP_MAGIC, 4);
+        write_le32(header + 4, block_games);
+        write_le32(header + 8, raw.size() / SP_RECORD_SIZE);
+        write_le32(header + 12, payload_size | (compress ? SP_COMPRESSED : 0));
+        return fwrite(header, 1, SP_HEADER_SIZE, out) == SP_HEADER_SIZE
+            && fwrite(payload, 1, payload_size, out) == payload_size && fflush(out) == 0;
+    }
+
+    // Plays game number g and appends its records to raw
+    void play_game(Game &game, UINT64 g, vector<unsigned char> &raw) {
+        UINT64 state = seed ^ mix64(g);
+        game.new_game(BLACK);
+        UINT end;
+        vector<Game::Move> moves;
+        UINT WP, BP, K, turn;
+        for(int ply = 0; ply < random_plies && !game.is_game_over(); ply++) {
+            game.get_board(WP, BP, K, turn);
+            game.get_moves(turn, WP, BP, K, end, moves);
+            state += 0x9E3779B97F4A7C15ULL;
+            Game::Move move = moves[mix64(state) % moves.size()];
+            game.apply_move(move.start, move.end);
+        }
+
+        size_t first = raw.size();
+        int ply = random_plies;
+        for(; ply < SP_MAX_PLIES && !game.is_game_over(); ply++) {
+            game.get_board(WP, BP, K, turn);
+            game.get_moves(turn, WP, BP, K, end, moves);
+            Game::Move best = game.search_position(MAX_PLY - 1);
+            bool forced = moves.size() == 1;
+            // No score to record if the node limit ran out before the first iteration completed
+            if(forced || cpu_maxdepth > 0) {
+                raw.resize(raw.size() + SP_RECORD_SIZE);
+                encode_sp_record(&raw[raw.size() - SP_RECORD_SIZE], WP, BP, K, turn, RESULT_UNKNOWN,
+                                 forced ? 0 : game.get_pv_score(), best.start, best.end, ply, forced ? SP_FORCED : 0);
+            }
+            game.apply_move(best.start, best.end);
+        }
+
+        // The side left without moves loses, repetitions, the no-progress rule and SP_MAX_PLIES draw
+        game.get_board(WP, BP, K, turn);
+        UINT result = RESULT_DRAW;
+        if(ply < SP_MAX_PLIES && !game.is_draw_by_rule())
+            result = turn == WHITE ? RESULT_BLACK_WIN : RESULT_WHITE_WIN;
+        for(size_t i = first; i < raw.size(); i += SP_RECORD_SIZE)
+            raw[i + 17] = result;
+    }
+
+    // Resumes shard, false on an I/O error
+    bool run_shard(const string &prefix, int shard) {
+        string path = prefix + "." + to_string(shard) + ".sp";
+        UINT64 done = 0;
+        size_t valid = 0;
+        {
+            MappedFile existing;
+            if(existing.open(path))
+                valid = for_each_sp_block((const unsigned char *)existing.data(), existing.size(),
+                                          [&](const unsigned char *header, const unsigned char *) {
+                    done += read_le32(header + 4);
+                });
+        }
+        FILE *out = fopen(path.c_str(), valid ? "r+b" : "wb");
+        if(!out || ftruncate(fileno(out), valid) != 0 || fseek(out, valid, SEEK_SET) != 0) {
+            cerr << "Error: Cannot write " << path << endl;
+            if(out)
+                fclose(out);
+            return false;
+        }
+
+        Game game;
+        game.set_eval_noise(false);
+        game.set_node_limit(node_limit);
+        vector<unsigned char> raw;
+        UINT block_games = 0;
+        UINT64 written = 0;
+        bool ok = true;
+        for(UINT64 g = shard + done * shards; g < games && ok; g += shards) {
+            play_game(game, g, raw);
+            block_games++;
+            games_played++;
+            if(block_games == SP_BLOCK_GAMES || g + shards >= games) {
+                ok = write_block(out, raw, block_games);
+                written += raw.size() / SP_RECORD_SIZE;
+                positions_written += raw.size() / SP_RECORD_SIZE;
+                raw.clear();
+                block_games = 0;
+            }
+        }
+        fclose(out);
+        lock_guard<mutex> lock(report_mutex);
+        if(!ok)
+            cerr << "Error: Cannot write " << path << endl;
+        else
+            cout << path << ": " << done << " games kept, " << written << " positions added" << endl;
+        return ok;
+    }
+
+public:
+    SelfPlay(UINT64 games, int shards, UINT64 node_limit, int random_plies, bool compress, UINT64 seed)
+        : games(games), node_limit(node_limit), seed(seed), shards(shards), random_plies(random_plies),
+          compress(compress), next_shard(0), games_played(0), positions_written(0) {}
+
+    // Runs the shards in list on threads threads, false if any of them failed
+    bool run(const string &prefix, const vector<int> &list, int threads) {
+        atomic<bool> failed(false);
+        vector<thread> workers;
+        for(int t = 0; t < threads && t < (int)list.size(); t++)
+            workers.push_back(thread([&]() {
+                for(int i; (i = next_shard++) < (int)list.size(); )
+                    if(!run_shard(prefix, list[i]))
+                        failed = true;
+            }));
+        for(thread &worker : workers)
+            worker.join();
+        return !failed;
+    }
+    UINT64 get_games() { return games_played; }
+    UINT64 get_positions() { return positions_written; }
+};
+
+
+//
+// TEST SUITES
+//
+// Runs a file of test positions, one per line as "<fen> bm <move> [<move> ...] [; id <name>]"
+// with '#' starting a comment, and records for each the depth, nodes and time of the first
+// iteration from which the best move stays among the expected ones. Moves are PDN, a jump is
+// matched by its first and last square. Threads each take whole positions and share the hash
+// table, so node counts only repeat from run to run with one thread, which also starts every
+// position from an empty table.
+//
+#define SUITE_DEFAULT_DEPTH 16
+
+class TestSuite {
+public:
+    struct Position {
+        string name, fen;
+        vector<pair<UINT,UINT> > moves;
+    };
+    struct Result {
+        string name;
+        bool solved;
+        int depth;
+        UINT64 nodes;
+        long long ms;
+    };
+
+private:
+    vector<Position> positions;
+    vector<Result> results;
+    atomic<int> next_position;
+    mutex report_mutex;
+
+    // "11-15", "22x15" or "22x15x8" to its first and last square, false if malformed
+    static bool parse_move(const string &str, UINT &start, UINT &end) {
+        vector<int> squares;
+        size_t i = 0;
+        while(i < str.size()) {
+            if(!isdigit((unsigned char)str[i]))
+                return false;
+            int square = 0;
+            while(i < str.size() && isdigit((unsigned char)str[i]))
+                square = square * 10 + (str[i++] - '0');
+            if(square < 1 || square > 32)
+                return false;
+            squares.push_back(square);
+            if(i < str.size() && str[i] != '-' && str[i] != 'x')
+                return false;
+            if(i < str.size() && ++i == str.size())
+                return false;
+        }
+        if(squares.size() < 2)
+            return false;
+        start = squares.front() - 1;
+        end = squares.back() - 1;
+        return true;
+    }
+
+    bool is_expected(const Position &position, const Game::Move &move) {
+        for(size_t i = 0; i < position.moves.size(); i++)
+            if(position.moves[i].first == move.start && position.moves[i].second == move.end)
+                return true;
+        return false;
+    }
+
+    Result run_position(Game &game, const Position &position, int depth, int time_ms) {
+        Result result = { position.name, false, 0, 0, 0 };
+        bool settled = false;
+        game.set_position(position.fen);
+
+        // A single legal move is played without a search, it is solved at depth 0 if expected
+        UINT WP, BP, K, turn, end;
+        vector<Game::Move> moves;
+        game.get_board(WP, BP, K, turn);
+        game.get_moves(turn, WP, BP, K, end, moves);
+        if(moves.size() == 1) {
+            result.solved = is_expected(position, moves[0]);
+            return result;
+        }
+
+        shared_ptr<Game::SearchJob> job = game.search_async(depth, time_ms, [&](const Game::SearchInfo &info) {
+            if(!is_expected(position, info.best))
+                settled = false;
+            else if(!settled) {
+                settled = true;
+                result.depth = info.depth;
+                result.nodes = info.nodes;
+                result.ms = info.ms;
+            }
+        });
+        job->wait();
+        result.solved = settled;
+        return result;
+    }
+
+public:
+    TestSuite() : next_position(0) {}
+
+    // Reads path, false with the offending line in error if it cannot
+    bool load(const string &path, string &error) {
+        ifstream file(path.c_str());
+        if(!file) {
+            error = "Cannot open " + path;
+            return false;
+        }
+        string line;
+        for(int number = 1; getline(file, line); number++) {
+            line = line.substr(0, line.find('#'));
+            string name;
+            size_t semicolon = line.find(';');
+            if(semicolon != string::npos) {
+                stringstream ss(line.substr(semicolon + 1));
+                string key;
+                if(!(ss >> key >> name) || key != "id") {
+                    error = path + ":" + to_string(number) + ": expected \"; id <name>\"";
+                    return false;
+                }
+                line = line.substr(0, semicolon);
+            }
+            stringstream ss(line);
+            Position position;
+            string word;
+            if(!(ss >> position.fen))
+                continue;
+            UINT WP, BP, K, turn;
+            const char *fen_end = position.fen.data() + position.fen.size();
+            bool ok = parse_fen(position.fen.data(), fen_end, WP, BP, K, turn) == fen_end && (ss >> word) && word == "bm";
+            while(ok && ss >> word) {
+                UINT start, end;
+                if((ok = parse_move(word, start, end)))
+                    position.moves.push_back(make_pair(start, end));
+            }
+            if(!ok || position.moves.empty()) {
+                error = path + ":" + to_string(number) + ": expected \"<fen> bm <move> ...\"";
+                return false;
+            }
+            position.name = name.empty() ? to_string(positions.size() + 1) : name;
+            positions.push_back(position);
+        }
+        return true;
+    }
+
+    // Searches every position to depth or for time_ms each (0 = no limit) on threads threads
+    void run(int depth, int time_ms, int threads) {
+        results.assign(positions.size(), Result());
+        next_position = 0;
+        vector<thread> workers;
+        for(int t = 0; t < threads && t < (int)positions.size(); t++)
+            workers.push_back(thread([this, depth, time_ms, threads]() {
+                Game game;
+                game.set_eval_noise(false);
+                for(int i; (i = next_position++) < (int)positions.size(); ) {
+                    if(threads == 1)
+                        trans_table.clear();
+                    results[i] = run_position(game, positions[i], depth, time_ms);
+                    const Result &r = results[i];
+                    lock_guard<mutex> lock(report_mutex);
+                    cout << setw(12) << left << r.name << right;
+                    if(r.solved)
+                        cout << "  solved  depth " << setw(2) << r.depth << "  nodes " << setw(10) << r.nodes
+                             << "  time " << r.ms << " ms" << endl;
+                    else
+                        cout << "  not solved" << endl;
+                }
+            }));
+        for(thread &worker : workers)
+            worker.join();
+    }
+
+    const vector<Result> &get_results() { return results; }
+    int get_solved() {
+        int solved = 0;
+        for(size_t i = 0; i < results.size(); i++)
+            solved += results[i].solved;
+        return solved;
+    }
+
+    // One "name,solved,depth,nodes,ms" line per position
+    bool save(const string &path) {
+        ofstream file(path.c_str());
+        for(size_t i = 0; i < results.size(); i++)
+            file << results[i].name << "," << results[i].solved << "," << results[i].depth << ","
+                 << results[i].nodes << "," << results[i].ms << "\n";
+        return bool(file);
+    }
+
+    static bool load_results(const string &path, vector<Result> &baseline) {
+        ifstream file(path.c_str());
+        if(!file)
+            return false;
+        string line;
+        while(getline(file, line)) {
+            Result r;
+            int solved;
+            size_t comma = line.find(',');
+            if(comma == string::npos
+               || sscanf(line.c_str() + comma + 1, "%d,%d,%llu,%lld", &solved, &r.depth, (unsigned long long *)&r.nodes, &r.ms) != 4)
+                return false;
+            r.name = line.substr(0, comma);
+            r.solved = solved != 0;
+            baseline.push_back(r);
+        }
+        return true;
+    }
+
+    // Lists the positions solved or lost since baseline, then the geometric means of the
+    // node and time ratios over the positions both runs solved (below 1 is faster)
+    void compare(const vector<Result> &baseline) {
+        map<string, const Result *> before;
+        for(size_t i = 0; i < baseline.size(); i++)
+            before[baseline[i].name] = &baseline[i];
+        int both = 0, gained = 0, lost = 0, base_solved = 0;
+        double log_nodes = 0, log_ms = 0;
+        for(size_t i = 0; i < baseline.size(); i++)
+            base_solved += baseline[i].solved;
+        for(size_t i = 0; i < results.size(); i++) {
+            const Result &r = results[i];
+            map<string, const Result *>::iterator it = before.find(r.name);
+            if(it == before.end())
+                continue;
+            const Result &b = *it->second;
+            if(r.solved && b.solved) {
+                both++;
+                log_nodes += log(double(max(r.nodes, (UINT64)1)) / max(b.nodes, (UINT64)1));
+                log_ms += log(double(max(r.ms, 1LL)) / max(b.ms, 1LL));
+            }
+            else if(r.solved != b.solved) {
+                (r.solved ? gained : lost)++;
+                cout << setw(12) << left << r.name << right << (r.solved ? "  now solved" : "  no longer solved") << endl;
+            }
+        }
+        cout << "solved " << get_solved() << "/" << results.size() << "  baseline " << base_solved << "/" << baseline.size()
+             << "  gained " << gained << "  lost " << lost << endl;
+        if(both)
+            cout << "over " << both << " solved by both: nodes x" << fixed << setprecision(3) << exp(log_nodes / both)
+                 << "  time x" << exp(log_ms / both) << endl;
+    }
+};
+
+
+//
+// SERVER
+//
+// Hosts many games at once over a local socket. Each connection sends one command per line
+// and gets one reply line per command:
+//   new <id> [budget_ms] [w|b] [ab|mcts]
+//                                start a game, w/b picks the side to move first (default w) and
+//                                ab/mcts the computer's search, alpha-beta (default) or MCTS
+//   setup <id> <fen>             replace the position of a game
+//   move <id> <from> <to>        play a move for the side to move, ex. 'move g1 6e 5f'
+//   go <id> [budget_ms]          let the computer move, queued for the worker pool
+//   board <id>                   position as a FEN
+//   moves <id>                   legal moves
+//   close <id>                   end a game
+//   stats                        queue depth and request latency percentiles
+//   quit / shutdown              close this connection / stop the server
+// 'go' requests are served earliest-deadline first, the deadline being arrival time plus
+// the game's budget, and all alpha-beta searches share the process wide trans_table. An MCTS
+// game searches on its worker's thread alone and keeps its tree between moves.
+//
+volatile sig_atomic_t server_quit;
+void serverSignalHandler(int) {
+    server_quit = true;
+}
+
+class Server {
+
+    struct Client {
+        int fd;
+        bool open;
+        mutex write_mutex;
+        string in_buf;
+    };
+
+    struct Session {
+        Game game;
+        unique_ptr<MctsSearch> mcts;
+        int budget_ms;
+        bool busy;
+    };
+
+    struct Request {
+        long long arrival, deadline;
+        UINT64 seq;
+        string id;
+        shared_ptr<Client> client;
+    };
+    struct Later_Deadline {
+        bool operator()(const Request &a, const Request &b) const {
+            return (a.deadline != b.deadline) ? (a.deadline > b.deadline) : (a.seq > b.seq);
+        }
+    };
+
+    int listen_fd;
+    int num_workers;
+    vector<thread> workers;
+
+    mutex sessions_mutex;
+    map<string, shared_ptr<Session> > sessions;
+
+    mutex queue_mutex;
+    condition_variable queue_cv;
+    vector<Request> queue;  // heap ordered by Later_Deadline
+    UINT64 next_seq;
+    size_t max_queue_depth;
+    int busy_workers;
+
+    // Latencies of the last LATENCY_SAMPLES 'go' requests, arrival to reply, in ms
+    static const int LATENCY_SAMPLES = 8192;
+    mutex stats_mutex;
+    vector<double> latencies;
+    UINT64 requests_served;
+    UINT64 nodes_searched, tt_probes, tt_hits, playouts;
+
+    // Table file saved every TT_FILE_SAVE_SECONDS and at shutdown, none if empty. Its games
+    // search without eval noise, which would otherwise be saved with the scores
+    string table_path;
+    long long next_save_ms;
+
+    static void send_line(shared_ptr<Client> client, const string &line) {
+        lock_guard<mutex> lock(client->write_mutex);
+        if(!client->open)
+            return;
+        string out = line + "\n";
+        size_t sent = 0;
+        while(sent < out.size()) {
+            ssize_t n = send(client->fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0)
+                return;
+            sent += n;
+        }
+    }
+
+    // Square from the "6e" form used at the move prompt, 33 if it is not a playable square
+    static UINT parse_square(Game &game, const string &coord) {
+        if(coord.size() != 2 || coord[0] < '1' || coord[0] > '8' || coord[1] < 'a' || coord[1] > 'h')
+            return 33;
+        return game.coord_to_bitnum(coord[0] - '0', coord[1]);
+    }
+
+    shared_ptr<Session> find_session(const string &id) {
+        lock_guard<mutex> lock(sessions_mutex);
+        map<string, shared_ptr<Session> >::iterator itr = sessions.find(id);
+        return (itr == sessions.end()) ? shared_ptr<Session>() : itr->second;
+    }
+
+    // MCTS counterpart of Game::timed_move()
+    static bool mcts_move(Session &session, long long deadline, UINT &start, UINT &end) {
+        UINT WP, BP, K, turn;
+        session.game.get_board(WP, BP, K, turn);
+        Game::Move move = session.mcts->search(WP, BP, K, turn, (int)::max(deadline - now_ms(), 1LL), 0);
+        if(move == Game::Move(0,0,0,0,0) || !session.game.apply_move(move.start, move.end))
+            return false;
+        start = move.start;
+        end = move.end;
+        return true;
+    }
+
+    void worker_loop() {
+        while(true) {
+            Request request;
+            {
+                unique_lock<mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [this] { return server_quit || !queue.empty(); });
+                if(server_quit)
+                    return;
+                pop_heap(queue.begin(), queue.end(), Later_Deadline());
+                request = queue.back();
+                queue.pop_back();
+                busy_workers++;
+            }
+
+            // A request that waited out its budget in the queue still gets a tenth of it to search
+            shared_ptr<Session> session = find_session(request.id);
+            long long now = now_ms();
+            string reply;
+            if(!session)
+                reply = "err go " + request.id + " no such game";
+            else {
+                long long deadline = ::max(request.deadline, now + session->budget_ms / 10);
+                UINT start, end;
+                if(session->mcts && mcts_move(*session, deadline, start, end)) {
+                    stringstream ss;
+                    ss << "ok go " << request.id << " " << session->game.bitnum_to_short_coord(start)
+                       << " " << session->game.bitnum_to_short_coord(end)
+                       << " playouts " << session->mcts->get_playouts() << " ms " << (now_ms() - now)
+                       << " pv " << session->mcts->pv_string();
+                    reply = ss.str();
+                }
+                else if(!session->mcts && session->game.timed_move(deadline, start, end)) {
+                    stringstream ss;
+                    ss << "ok go " << request.id << " " << session->game.bitnum_to_short_coord(start)
+                       << " " << session->game.bitnum_to_short_coord(end)
+                       << " depth " << cpu_maxdepth << " nodes " << session->game.get_nodes()
+                       << " ms " << (now_ms() - now);
+                    if(!session->game.get_pv().empty())
+                        ss << " pv " << session->game.pv_string();
+                    reply = ss.str();
+                }
+                else
+                    reply = "ok gameover " + request.id + " " + session->game.winner_string();
+            }
+
+            long long done = now_ms();
+            {
+                lock_guard<mutex> lock(stats_mutex);
+                if(latencies.size() < LATENCY_SAMPLES)
+                    latencies.push_back(done - request.arrival);
+                else
+                    latencies[requests_served % LATENCY_SAMPLES] = done - request.arrival;
+                requests_served++;
+                if(session && session->mcts)
+                    playouts += session->mcts->get_playouts();
+                else if(session) {
+                    nodes_searched += session->game.get_nodes();
+                    tt_probes += session->game.get_tt_probes();
+                    tt_hits += session->game.get_tt_hits();
+                }
+            }
+            if(session) {
+                lock_guard<mutex> lock(sessions_mutex);
+                session->busy = false;
+            }
+            {
+                lock_guard<mutex> lock(queue_mutex);
+                busy_workers--;
+            }
+            send_line(request.client, reply);
+        }
+    }
+
+    string stats_string() {
+        stringstream ss;
+        size_t games;
+        {
+            lock_guard<mutex> lock(sessions_mutex);
+            games = sessions.size();
+        }
+        ss << "ok stats games " << games;
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            ss << " queue " << queue.size() << " max_queue " << max_queue_depth
+               << " workers " << num_workers << " busy " << busy_workers;
+        }
+        lock_guard<mutex> lock(stats_mutex);
+        vector<double> sorted(latencies);
+        sort(sorted.begin(), sorted.end());
+        double pct[4] = {0.50, 0.90, 0.99, 1.0};
+        const char *names[4] = {"p50", "p90", "p99", "max"};
+        ss << " requests " << requests_served;
+        for(int i = 0; i < 4; i++) {
+            double value = sorted.empty() ? 0 : sorted[::min(sorted.size() - 1, (size_t)(pct[i] * sorted.size()))];
+            ss << " " << names[i] << "_ms " << value;
+        }
+        ss << " nodes " << nodes_searched << " playouts " << playouts << " tt_hit_rate " << fixed << setprecision(3)
+           << (tt_probes ? double(tt_hits) / tt_probes : 0.0);
+        return ss.str();
+    }
+
+    // Handles one command line, returns false when the client should be disconnected
+    bool handle_line(shared_ptr<Client> client, const string &line) {
+        stringstream ss(line);
+        string cmd, id;
+        ss >> cmd >> id;
+        if(cmd.empty())
+            return true;
+
+        if(cmd == "quit")
+            return false;
+        if(cmd == "shutdown") {
+            server_quit = true;
+            send_line(client, "ok shutdown");
+            return false;
+        }
+        if(cmd == "stats") {
+            send_line(client, stats_string());
+            return true;
+        }
+        if(id.empty()) {
+            send_line(client, "err " + cmd + " missing game id");
+            return true;
+        }
+
+        if(cmd == "new") {
+            int budget_ms = 1000;
+            string first = "w", engine = "ab";
+            ss >> budget_ms >> first >> engine;
+            if(budget_ms <= 0 || (first != "w" && first != "b") || (engine != "ab" && engine != "mcts")) {
+                send_line(client, "err new " + id + " bad arguments");
+                return true;
+            }
+            shared_ptr<Session> session(new Session());
+            session->budget_ms = budget_ms;
+            session->busy = false;
+            session->game.new_game(first == "w" ? WHITE : BLACK);
+            if(!table_path.empty())
+                session->game.set_eval_noise(false);
+            if(engine == "mcts")
+                session->mcts.reset(new MctsSearch(1, MCTS_SERVER_MB));
+            lock_guard<mutex> lock(sessions_mutex);
+            if(sessions.count(id) && sessions[id]->busy) {
+                send_line(client, "err new " + id + " busy");
+                return true;
+            }
+            sessions[id] = session;
+            send_line(client, "ok new " + id);
+            return true;
+        }
+
+        shared_ptr<Session> session = find_session(id);
+        if(!session) {
+            send_line(client, "err " + cmd + " " + id + " no such game");
+            return true;
+        }
+
+        // Everything below touches the game, which belongs to a worker while a search runs
+        unique_lock<mutex> lock(sessions_mutex);
+        if(session->busy) {
+            send_line(client, "err " + cmd + " " + id + " busy");
+            return true;
+        }
+
+        if(cmd == "close") {
+            sessions.erase(id);
+            send_line(client, "ok close " + id);
+        }
+        else if(cmd == "board")
+            send_line(client, "ok board " + id + " " + session->game.fen_string());
+        else if(cmd == "setup") {
+            string fen;
+            ss >> fen;
+            if(session->game.set_position(fen))
+                send_line(client, "ok setup " + id);
+            else
+                send_line(client, "err setup " + id + " bad fen");
+        }
+        else if(cmd == "moves")
+            send_line(client, "ok moves " + id + " " + session->game.legal_moves_string());
+        else if(cmd == "move") {
+            string from, to;
+            ss >> from >> to;
+            UINT start = parse_square(session->game, from);
+            UINT end = parse_square(session->game, to);
+            if(session->game.apply_move(start, end))
+                send_line(client, "ok move " + id);
+            else
+                send_line(client, "err move " + id + " illegal move");
+        }
+        else if(cmd == "go") {
+            int budget_ms;
+            if(ss >> budget_ms && budget_ms > 0)
+                session->budget_ms = budget_ms;
+            if(session->game.is_game_over()) {
+                send_line(client, "ok gameover " + id + " " + session->game.winner_string());
+                return true;
+            }
+            session->busy = true;
+            lock.unlock();
+
+            Request request;
+            request.arrival = now_ms();
+            request.deadline = request.arrival + session->budget_ms;
+            request.id = id;
+            request.client = client;
+            {
+                lock_guard<mutex> qlock(queue_mutex);
+                request.seq = next_seq++;
+                queue.push_back(request);
+                push_heap(queue.begin(), queue.end(), Later_Deadline());
+                max_queue_depth = ::max(max_queue_depth, queue.size());
+            }
+            queue_cv.notify_one();
+        }
+        else
+            send_line(client, "err " + cmd + " unknown command");
+        return true;
+    }
+
+public:
+    Server() {
+        listen_fd = -1;
+        num_workers = 0;
+        next_seq = 0;
+        max_queue_depth = 0;
+        busy_workers = 0;
+        requests_served = 0;
+        nodes_searched = tt_probes = tt_hits = playouts = 0;
+        next_save_ms = 0;
+    }
+
+    void set_table_file(const string &path) {
+        table_path = path;
+        next_save_ms = now_ms() + TT_FILE_SAVE_SECONDS * 1000LL;
+    }
+
+    // Listen on a unix domain socket, or on 127.0.0.1:port when port > 0
+    bool open_socket(const string &socket_path, int port) {
+        if(port > 0) {
+            listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            int yes = 1;
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if(listen_fd < 0 || ::bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+                cerr << "Error: Cannot bind to 127.0.0.1:" << port << endl;
+                return false;
+            }
+        }
+        else {
+            listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if(socket_path.size() >= sizeof(addr.sun_path)) {
+                cerr << "Error: Socket path is too long." << endl;
+                return false;
+            }
+            strcpy(addr.sun_path, socket_path.c_str());
+            unlink(socket_path.c_str());
+            if(listen_fd < 0 || ::bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+                cerr << "Error: Cannot bind to " << socket_path << endl;
+                return false;
+            }
+        }
+        if(listen(listen_fd, 64) < 0) {
+            cerr << "Error: Cannot listen on socket." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    void run(int threads) {
+        signal(SIGINT, serverSignalHandler);
+        signal(SIGTERM, serverSignalHandler);
+
+        num_workers = threads;
+        for(int i = 0; i < num_workers; i++)
+            workers.push_back(thread(&Server::worker_loop, this));
+
+        // The accepting thread multiplexes every connection, searches happen on the workers
+        map<int, shared_ptr<Client> > clients;
+        char buf[4096];
+        while(!server_quit) {
+            if(!table_path.empty() && now_ms() >= next_save_ms) {
+                close_table_file(table_path);
+                next_save_ms = now_ms() + TT_FILE_SAVE_SECONDS * 1000LL;
+            }
+
+            vector<pollfd> fds;
+            pollfd pfd;
+            pfd.fd = listen_fd;
+            pfd.events = POLLIN;
+            fds.push_back(pfd);
+            for(map<int, shared_ptr<Client> >::iterator itr = clients.begin(); itr != clients.end(); itr++) {
+                pfd.fd = itr->first;
+                fds.push_back(pfd);
+            }
+
+            if(poll(&fds[0], fds.size(), 200) <= 0)
+                continue;
+
+            if(fds[0].revents & POLLIN) {
+                int fd = accept(listen_fd, NULL, NULL);
+                if(fd >= 0) {
+                    shared_ptr<Client> client(new Client());
+                    client->fd = fd;
+                    client->open = true;
+                    clients[fd] = client;
+                }
+            }
+
+            for(size_t i = 1; i < fds.size(); i++) {
+                if(!fds[i].revents)
+                    continue;
+                shared_ptr<Client> client = clients[fds[i].fd];
+                ssize_t n = recv(client->fd, buf, sizeof(buf), 0);
+                bool keep = n > 0;
+                if(keep)
+                    client->in_buf.append(buf, n);
+
+                size_t pos;
+                while(keep && (pos = client->in_buf.find('\n')) != string::npos) {
+                    string line = client->in_buf.substr(0, pos);
+                    client->in_buf.erase(0, pos + 1);
+                    if(!line.empty() && line[line.size() - 1] == '\r')
+                        line.erase(line.size() - 1);
+                    keep = handle_line(client, line);
+                }
+
+                if(!keep) {
+                    lock_guard<mutex> lock(client->write_mutex);
+                    client->open = false;
+                    close(client->fd);
+                    clients.erase(fds[i].fd);
+                }
+            }
+        }
+
+        queue_cv.notify_all();
+        for(int i = 0; i < num_workers; i++)
+            workers[i].join();
+        for(map<int, shared_ptr<Client> >::iterator itr = clients.begin(); itr != clients.end(); itr++)
+            close(itr->first);
+        close(listen_fd);
+        close_table_file(table_path);
+    }
+};
+
+
+unsigned char Game::bitCount_Tbl[65536];
+unsigned char Game::msb_Tbl[65536];
+unsigned char Game::lsb_Tbl[65536];
+once_flag Game::tables_ready;
+int Game::batch_lanes = Game::detect_batch_lanes();
+
+
+int run_server(int argc, char *argv[]) {
+    string socket_path = "/tmp/checkersai.sock";
+    int port = 0;
+    int threads = thread::hardware_concurrency();
+    int hash_mb = TT_DEFAULT_MB;
+    string shared_hash, table_file;
+
+    for(int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--socket" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if(arg == "--port" && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(arg == "--hash" && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if(arg == "--shared-hash" && i + 1 < argc)
+            shared_hash = argv[++i];
+        else if(arg == "--hash-file" && i + 1 < argc)
+            table_file = argv[++i];
+        else
+            hash_mb = 0;
+    }
+    if(hash_mb < 1) {
+        cerr << "Usage: " << argv[0] << " server [--socket path | --port n] [--threads n] [--hash mb] [--shared-hash name] [--hash-file path]" << endl;
+        return 1;
+    }
+    if(threads <= 0)
+        threads = 1;
+
+    if(!open_trans_table(shared_hash, hash_mb))
+        return 1;
+    open_table_file(table_file);
+    Server server;
+    if(!server.open_socket(socket_path, port))
+        return 1;
+    server.set_table_file(table_file);
+    cout << "Serving on " << (port > 0 ? "127.0.0.1:" + to_string(port) : socket_path)
+         << " with " << threads << " worker threads" << endl;
+    server.run(threads);
+    if(port <= 0)
+        unlink(socket_path.c_str());
+    return 0;
+}
+
+
+// Converts between FEN text and 16 byte binary position files
+int run_convert(int argc, char *argv[]) {
+    if(argc != 4) {
+        cerr << "Usage: " << argv[0] << " convert <in> <out>   (.bin = binary records, otherwise FEN lines)" << endl;
+        return 1;
+    }
+    PositionFile in;
+    if(!in.open(argv[2])) {
+        cerr << "Error: Cannot open " << argv[2] << endl;
+        return 1;
+    }
+    FILE *out = fopen(argv[3], "wb");
+    if(!out) {
+        cerr << "Error: Cannot create " << argv[3] << endl;
+        return 1;
+    }
+
+    bool out_binary = PositionFile::is_binary_name(argv[3]);
+    static char buf[1 << 16];
+    size_t used = 0, bad_lines = 0;
+    long long t1 = now_ms();
+    size_t count = in.for_each([&](UINT WP, UINT BP, UINT K, UINT turn, UINT result) {
+        if(used + FEN_MAX_LEN + 1 > sizeof(buf)) {
+            fwrite(buf, 1, used, out);
+            used = 0;
+        }
+        if(out_binary) {
+            encode_record((unsigned char *)buf + used, WP, BP, K, turn, result);
+            used += POS_RECORD_SIZE;
+        }
+        else {
+            used += write_fen(buf + used, WP, BP, K, turn);
+            buf[used++] = '\n';
+        }
+    }, &bad_lines);
+    fwrite(buf, 1, used, out);
+    fclose(out);
+
+    long long ms = now_ms() - t1;
+    cout << "Converted " << count << " positions in " << ms << " ms";
+    if(bad_lines)
+        cout << " (" << bad_lines << " malformed lines skipped)";
+    cout << endl;
+    return 0;
+}
+
+
+// Replays a PDN file, optionally writing every position with its game result (.bin or FEN lines)
+int run_replay(int argc, char *argv[]) {
+    string out_path;
+    if(argc == 5 && string(argv[3]) == "--out")
+        out_path = argv[4];
+    else if(argc != 3) {
+        cerr << "Usage: " << argv[0] << " replay <games.pdn> [--out positions.bin]" << endl;
+        return 1;
+    }
+    MappedFile in;
+    if(!in.open(argv[2])) {
+        cerr << "Error: Cannot open " << argv[2] << endl;
+        return 1;
+    }
+    FILE *out = NULL;
+    if(!out_path.empty() && !(out = fopen(out_path.c_str(), "wb"))) {
+        cerr << "Error: Cannot create " << out_path << endl;
+        return 1;
+    }
+
+    bool out_binary = PositionFile::is_binary_name(out_path);
+    static char buf[1 << 16];
+    size_t used = 0;
+    Game game;
+    PdnReplayer replayer(game);
+    long long t1 = now_ms();
+    PdnStats stats = replayer.replay(in.data(), in.data() + in.size(),
+        [&](UINT WP, UINT BP, UINT K, UINT turn, UINT result) {
+            if(!out)
+                return;
+            if(used + FEN_MAX_LEN + 1 > sizeof(buf)) {
+                fwrite(buf, 1, used, out);
+                used = 0;
+            }
+            if(out_binary) {
+                encode_record((unsigned char *)buf + used, WP, BP, K, turn, result);
+                used += POS_RECORD_SIZE;
+            }
+            else {
+                used += write_fen(buf + used, WP, BP, K, turn);
+                buf[used++] = '\n';
+            }
+        });
+    long long ms = now_ms() - t1;
+    if(out) {
+        fwrite(buf, 1, used, out);
+        fclose(out);
+    }
+
+    cout << "Replayed " << stats.games << " games (" << stats.bad_games << " with illegal moves), "
+         << stats.plies << " plies in " << ms << " ms";
+    if(ms > 0)
+        cout << ", " << (UINT64)(stats.plies * 1000.0 / ms) << " plies/sec";
+    cout << endl;
+    return 0;
+}
+
+
+// Fixed depth (or time) analysis of a position with the parallel search
+int run_analyze(int argc, char *argv[]) {
+    int depth = 12, threads = thread::hardware_concurrency(), time_ms = 0, hash_mb = TT_DEFAULT_MB, multi_pv = 1;
+    string fen = (argc > 2) ? argv[2] : "", shared_hash, table_file;
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--depth" && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else if(arg == "--multipv" && i + 1 < argc)
+            multi_pv = atoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(arg == "--time" && i + 1 < argc)
+            time_ms = atoi(argv[++i]);
+        else if(arg == "--hash" && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if(arg == "--shared-hash" && i + 1 < argc)
+            shared_hash = argv[++i];
+        else if(arg == "--hash-file" && i + 1 < argc)
+            table_file = argv[++i];
+        else
+            fen.clear();
+    }
+    UINT WP, BP, K, turn;
+    if(fen.empty() || !parse_fen(fen.data(), fen.data() + fen.size(), WP, BP, K, turn) || depth < 1 || multi_pv < 1
+       || (hash_mb <= 0 && (!table_file.empty() || !shared_hash.empty() || multi_pv > 1))) {
+        cerr << "Usage: " << argv[0] << " analyze <fen> [--depth d] [--time ms] [--threads n] [--hash mb, 0 = off] [--shared-hash name] [--hash-file path]" << endl
+             << "       " << argv[0] << " analyze <fen> --multipv k [--depth d] [--time ms] [--hash mb, 1 or more] [--shared-hash name] [--hash-file path]" << endl;
+        return 1;
+    }
+    if(hash_mb > 0 && !open_trans_table(shared_hash, hash_mb))
+        return 1;
+    open_table_file(table_file);
+
+    // Several lines are searched by one thread, the hash table is what makes them cheap
+    if(multi_pv > 1) {
+        Game game;
+        game.set_eval_noise(false);
+        game.set_position(fen);
+        game.analyze_multi_pv(multi_pv, depth, time_ms);
+        close_table_file(table_file);
+        return 0;
+    }
+
+    YbwcSearch search(threads, hash_mb > 0);
+    search.analyze(WP, BP, K, turn, depth, time_ms);
+    close_table_file(table_file);
+    return 0;
+}
+
+
+// Tunes the heuristics() weights on a labelled .bin position file and writes CheckersWeights.h
+int run_tune(int argc, char *argv[]) {
+    string out_path = "CheckersWeights.h";
+    int epochs = 300, threads = thread::hardware_concurrency();
+    double rate = 2.0;
+    string in_path = (argc > 2) ? argv[2] : "";
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--out" && i + 1 < argc)
+            out_path = argv[++i];
+        else if(arg == "--epochs" && i + 1 < argc)
+            epochs = atoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(arg == "--rate" && i + 1 < argc)
+            rate = atof(argv[++i]);
+        else
+            in_path.clear();
+    }
+    if(!PositionFile::is_binary_name(in_path)) {
+        cerr << "Usage: " << argv[0] << " tune <labelled.bin> [--out CheckersWeights.h] [--epochs n] [--rate r] [--threads n]" << endl;
+        return 1;
+    }
+    PositionFile file;
+    if(!file.open(in_path)) {
+        cerr << "Error: Cannot open " << in_path << endl;
+        return 1;
+    }
+
+    Tuner tuner(threads);
+    long long t1 = now_ms();
+    size_t n = tuner.load(file);
+    cout << "Loaded " << n << " quiet labelled positions of " << file.num_records()
+         << " in " << (now_ms() - t1) << " ms" << endl;
+    if(n == 0)
+        return 1;
+
+    double before = tuner.fit_scale();
+    cout << "Initial error " << fixed << setprecision(6) << before << endl;
+    cout.unsetf(ios::fixed);
+    double after = tuner.optimize(epochs, rate);
+    tuner.print_weights();
+    if(!tuner.write_header(out_path, before, after)) {
+        cerr << "Error: Cannot write " << out_path << endl;
+        return 1;
+    }
+    cout << "Wrote " << out_path << ", rebuild to use the new weights." << endl;
+    return 0;
+}
+
+
+// Plays self-play games into <prefix>.<shard>.sp files, resuming any that already exist
+int run_selfplay(int argc, char *argv[]) {
+    string prefix = (argc > 2) ? argv[2] : "", shared_hash;
+    UINT64 games = 1000, nodes = SP_DEFAULT_NODES, seed = 1;
+    int threads = thread::hardware_concurrency(), shards = 0, shard = -1, random_plies = 8, hash_mb = TT_DEFAULT_MB;
+    bool compress = true;
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--games" && i + 1 < argc)
+            games = strtoull(argv[++i], NULL, 10);
+        else if(arg == "--shards" && i + 1 < argc)
+            shards = atoi(argv[++i]);
+        else if(arg == "--shard" && i + 1 < argc)
+            shard = atoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(arg == "--nodes" && i + 1 < argc)
+            nodes = strtoull(argv[++i], NULL, 10);
+        else if(arg == "--random-plies" && i + 1 < argc)
+            random_plies = atoi(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if(arg == "--raw")
+            compress = false;
+        else if(arg == "--hash" && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if(arg == "--shared-hash" && i + 1 < argc)
+            shared_hash = argv[++i];
+        else
+            prefix.clear();
+    }
+    if(threads < 1)
+        threads = 1;
+    if(shards < 1)
+        shards = threads;
+    if(prefix.empty() || shard >= shards || nodes < 1 || random_plies < 0 || hash_mb < 1) {
+        cerr << "Usage: " << argv[0] << " selfplay <prefix> [--games n] [--shards n] [--shard i] [--threads n] [--nodes n]" << endl
+             << "       [--random-plies n] [--seed n] [--raw] [--hash mb] [--shared-hash name]" << endl;
+        return 1;
+    }
+    if(!open_trans_table(shared_hash, hash_mb))
+        return 1;
+
+    vector<int> list;
+    for(int i = 0; i < shards; i++)
+        if(shard < 0 || i == shard)
+            list.push_back(i);
+    SelfPlay selfplay(games, shards, nodes, random_plies, compress, seed);
+    long long t1 = now_ms();
+    bool ok = selfplay.run(prefix, list, threads);
+    long long ms = max(now_ms() - t1, 1LL);
+    cout << "Played " << selfplay.get_games() << " games, " << selfplay.get_positions() << " positions in "
+         << ms << " ms (" << selfplay.get_positions() * 3600000 / ms << " positions/hour)" << endl;
+    return ok ? 0 : 1;
+}
+
+
+int run_perft(int argc, char *argv[]) {
+    int depth = 10, playouts = 0;
+    bool scalar = false, padded = false;
+    string fen = (argc > 2) ? argv[2] : "";
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--depth" && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else if(arg == "--playouts" && i + 1 < argc)
+            playouts = atoi(argv[++i]);
+        else if(arg == "--scalar")
+            scalar = true;
+        else if(arg == "--padded")
+            padded = true;
+        else
+            fen.clear();
+    }
+    Game game;
+    UINT WP, BP, K, turn = BLACK;
+    game.init_board(WP, BP, K);
+    bool ok = fen == "start" || (!fen.empty() && parse_fen(fen.data(), fen.data() + fen.size(), WP, BP, K, turn));
+    if(!ok || depth < 0 || playouts < 0) {
+        cerr << "Usage: " << argv[0] << " perft <fen | start> [--depth d] [--scalar | --padded] [--playouts n]" << endl;
+        return 1;
+    }
+
+    for(int d = 1; d <= depth; d++) {
+        long long t0 = now_ms();
+        UINT64 nodes = scalar ? game.perft_scalar(turn, WP, BP, K, d)
+                     : padded ? game.perft_padded(turn, pad_board(WP), pad_board(BP), pad_board(K), d)
+                     : game.perft(turn, WP, BP, K, d);
+        long long ms = now_ms() - t0;
+        cout << "depth " << setw(2) << d << "  nodes " << setw(14) << nodes << "  time " << setw(7) << ms << " ms  "
+             << fixed << setprecision(1) << nodes / 1000.0 / max(ms, 1LL) << " Mnps" << endl;
+    }
+
+    // Random games from the position, all of them moving in lockstep
+    if(playouts > 0) {
+        vector<UINT> wp(playouts, WP), bp(playouts, BP), k(playouts, K);
+        vector<int> result(playouts);
+        UINT64 plies;
+        long long t0 = now_ms();
+        game.random_playouts(turn, wp.data(), bp.data(), k.data(), playouts, 300, result.data(), &plies);
+        long long ms = now_ms() - t0;
+        int wins[4] = {0, 0, 0, 0};
+        for(int i = 0; i < playouts; i++)
+            wins[result[i]]++;
+        cout << "playouts " << playouts << "  white " << wins[RESULT_WHITE_WIN] << "  black " << wins[RESULT_BLACK_WIN]
+             << "  draw " << wins[RESULT_DRAW] << "  plies " << plies << "  time " << ms << " ms  "
+             << fixed << setprecision(1) << plies / 1000.0 / max(ms, 1LL) << " M plies/s" << endl;
+    }
+    return 0;
+}
+int run_solve(int argc, char *argv[]) {
+    int hash_mb = PN_DEFAULT_MB, max_ply = 120;
+    UINT64 node_limit = 0;
+    string fen = (argc > 2) ? argv[2] : "";
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--hash" && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if(arg == "--plies" && i + 1 < argc)
+            max_ply = atoi(argv[++i]);
+        else if(arg == "--nodes" && i + 1 < argc)
+            node_limit = strtoull(argv[++i], NULL, 10);
+        else
+            fen.clear();
+    }
+    UINT WP, BP, K, turn;
+    if(fen.empty() || !parse_fen(fen.data(), fen.data() + fen.size(), WP, BP, K, turn) || hash_mb < 1 || max_ply < 1) {
+        cerr << "Usage: " << argv[0] << " solve <fen> [--hash mb] [--plies n] [--nodes n, 0 = no limit]" << endl;
+        return 1;
+    }
+
+    PnSolver solver(hash_mb, max_ply, node_limit);
+    vector<Game::Move> line;
+    long long start = now_ms();
+    int result = solver.solve(WP, BP, K, turn, line);
+    long long ms = now_ms() - start;
+    string side = (turn == WHITE) ? "White" : "Black";
+    if(result == 1)
+        cout << side << " wins" << endl;
+    else if(result == 0)
+        cout << side << " has no forced win within " << max_ply << " plies" << endl;
+    else
+        cout << "Unknown, node limit reached" << endl;
+    cout << "nodes " << solver.get_nodes() << "  time " << ms << " ms" << endl;
+    if(result == 1) {
+        Game game;
+        cout << "line";
+        for(size_t i = 0; i < line.size(); i++)
+            cout << " " << game.move_to_pdn(line[i]);
+        cout << endl;
+    }
+    return result == 1 ? 0 : 2;
+}
+
+// Monte Carlo tree search of a position, reporting the playout rate once a second
+int run_mcts(int argc, char *argv[]) {
+    int threads = thread::hardware_concurrency(), time_ms = 5000, memory_mb = MCTS_DEFAULT_MB;
+    UINT64 playout_limit = 0;
+    string fen = (argc > 2) ? argv[2] : "";
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--time" && i + 1 < argc)
+            time_ms = atoi(argv[++i]);
+        else if(arg == "--playouts" && i + 1 < argc)
+            playout_limit = strtoull(argv[++i], NULL, 10);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(arg == "--memory" && i + 1 < argc)
+            memory_mb = atoi(argv[++i]);
+        else
+            fen.clear();
+    }
+    UINT WP, BP, K, turn;
+    if(fen.empty() || !parse_fen(fen.data(), fen.data() + fen.size(), WP, BP, K, turn) || time_ms < 0
+       || (time_ms == 0 && playout_limit == 0) || memory_mb < 1) {
+        cerr << "Usage: " << argv[0] << " mcts <fen> [--time ms, 0 = no limit] [--playouts n, 0 = no limit] [--threads n] [--memory mb]" << endl;
+        return 1;
+    }
+
+    // Searched a second at a time, each slice carrying on with the tree of the last
+    MctsSearch search(threads, memory_mb);
+    Game game;
+    Game::Move best(0,0,0,0,0);
+    UINT64 total = 0;
+    long long start = now_ms();
+    do {
+        long long left = time_ms ? time_ms - (now_ms() - start) : 1000;
+        best = search.search(WP, BP, K, turn, (int)::max(::min(left, 1000LL), 1LL), playout_limit ? playout_limit - total : 0);
+        total += search.get_playouts();
+        long long ms = ::max(now_ms() - start, 1LL);
+        cout << "playouts " << setw(9) << total << "  per sec " << setw(8) << total * 1000 / ms
+             << "  nodes " << search.get_nodes_used() << "  win " << fixed << setprecision(3) << search.root_value()
+             << "  pv " << search.pv_string() << endl;
+        cout.unsetf(ios::fixed);
+    } while(!search.is_full() && (!time_ms || now_ms() - start < time_ms) && (!playout_limit || total < playout_limit));
+    if(search.is_full())
+        cout << "Stopped with the tree at " << search.get_capacity() << " nodes, see --memory" << endl;
+    if(best == Game::Move(0,0,0,0,0))
+        cout << "No legal moves." << endl;
+    else
+        cout << "best " << game.move_to_pdn(best) << endl;
+    return 0;
+}
+
+// Plays MctsSearch against the alpha-beta search with the same time per move. Each opening of
+// random moves is played twice with the sides swapped, so neither engine gets the better ones.
+int run_match(int argc, char *argv[]) {
+    int games = 20, time_ms = 200, threads = 1, memory_mb = MCTS_DEFAULT_MB, random_plies = 6;
+    UINT64 seed = 1;
+    for(int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--games" && i + 1 < argc)
+            games = atoi(argv[++i]);
+        else if(arg == "--time" && i + 1 < argc)
+            time_ms = atoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(arg == "--memory" && i + 1 < argc)
+            memory_mb = atoi(argv[++i]);
+        else if(arg == "--random-plies" && i + 1 < argc)
+            random_plies = atoi(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else
+            games = 0;
+    }
+    if(games < 1 || time_ms < 1 || threads < 1 || memory_mb < 1 || random_plies < 0) {
+        cerr << "Usage: " << argv[0] << " match [--games n] [--time ms per move] [--threads n, MCTS only] [--memory mb]" << endl
+             << "       [--random-plies n] [--seed n]" << endl;
+        return 1;
+    }
 
-        do {
-            setup_parameters();
-            int mode;
-            char exist_board;
+    MctsSearch mcts(threads, memory_mb);
+    Game game;
+    game.set_eval_noise(false);
+    int wins = 0, draws = 0, losses = 0;
+    UINT64 playouts = 0, nodes = 0, reused = 0, mcts_moves = 0;
+    long long mcts_ms = 0, ab_ms = 0;
+    vector<Game::Move> moves;
+    for(int g = 0; g < games; g++) {
+        UINT64 state = seed ^ mix64(g / 2);
+        UINT mcts_side = g % 2 ? BLACK : WHITE;
+        UINT WP, BP, K, turn, end;
+        game.new_game(BLACK);
+        mcts.clear();
+        for(int ply = 0; ply < random_plies && !game.is_game_over(); ply++) {
+            game.get_board(WP, BP, K, turn);
+            game.get_moves(turn, WP, BP, K, end, moves);
+            state += 0x9E3779B97F4A7C15ULL;
+            Game::Move move = moves[mix64(state) % moves.size()];
+            game.apply_move(move.start, move.end);
+        }
 
-            while(true) {
-                cout << "Game modes available:" << endl
-                  << "1 - Human    VS. Human" << endl
-                  << "2 - Human    VS. Computer" << endl
-                  << "3 - Computer VS. Computer" << endl;
-                cout << "Please select a mode by number: ";
-                if(!(cin >> mode)) {
-                    cin.clear();
-                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    cout << "Error: Invalid input, please try again." << endl;
-                }
-                else if(mode != 1 && mode != 2 && mode != 3)
-                    cout << "Error: Please enter 1, 2, or 3." << endl;
-                else {
-                    cout << endl;
-                    break;
-                }
-                cout << endl;
+        int ply = random_plies;
+        for(; ply < SP_MAX_PLIES && !game.is_game_over(); ply++) {
+            game.get_board(WP, BP, K, turn);
+            long long t1 = now_ms();
+            if(turn == mcts_side) {
+                Game::Move move = mcts.search(WP, BP, K, turn, time_ms, 0);
+                game.apply_move(move.start, move.end);
+                playouts += mcts.get_playouts();
+                reused += mcts.get_reused();
+                mcts_moves++;
+                mcts_ms += now_ms() - t1;
             }
-
-            switch(mode) {
-                case 1:
-                    White_Player = HUMAN;
-                    BlacK_Player = HUMAN;
-                    break;
-                case 2:
-                    char wb;
-                    while(true) {
-                        cout << "Would you like to play as white or black (w/b)? ";
-                        if(!(cin >> wb)) {
-                            cin.clear();
-                            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                            cout << "Error: Invalid input, please try again." << endl;
-                        }
-                        else if(wb != 'w' && wb != 'b')
-                            cout << "Error: You did not enter w or b." << endl;
-                        else {
-                            cout << endl;
-                            break;
-                        }
-                    }
-                    if(wb == 'w') {
-                        White_Player = HUMAN;
-                        BlacK_Player = COMPUTER;
-                        cout << "You are white. The computer will play as black." << endl;
-                    }
-                    else if(wb == 'b') {
-                        BlacK_Player = HUMAN;
-                        White_Player = COMPUTER;
-                        cout << "You are black. The computer will play as white." << endl;
-                    }
-                    cout << endl;
-                    break;
-                case 3:
-                    White_Player = COMPUTER;
-                    BlacK_Player = COMPUTER;
-                    break;
+            else {
+                UINT start;
+                game.timed_move(t1 + time_ms, start, end);
+                nodes += game.get_nodes();
+                ab_ms += now_ms() - t1;
             }
+        }
 
+        // As in self-play: the side left without moves loses, anything else is a draw
+        game.get_board(WP, BP, K, turn);
+        string result = "draw";
+        if(ply < SP_MAX_PLIES && !game.is_draw_by_rule()) {
+            result = turn == mcts_side ? "alpha-beta wins" : "mcts wins";
+            (turn == mcts_side ? losses : wins)++;
+        }
+        else
+            draws++;
+        cout << "game " << setw(3) << g + 1 << "  mcts " << (mcts_side == WHITE ? "White" : "Black")
+             << "  " << ply << " plies  " << result << endl;
+    }
+    cout << "mcts +" << wins << " =" << draws << " -" << losses << "  score " << fixed << setprecision(1)
+         << 100.0 * (wins + 0.5 * draws) / games << "%" << endl;
+    cout << "mcts " << threads << " thread(s) " << playouts * 1000 / ::max(mcts_ms, 1LL) << " playouts/s, "
+         << reused / ::max(mcts_moves, (UINT64)1) << " nodes reused per move  alpha-beta "
+         << nodes * 1000 / ::max(ab_ms, 1LL) << " nodes/s" << endl;
+    return 0;
+}
 
-            while(true) {
-                cout << "Would you like to load an existing board (y/n)? ";
-                if(!(cin >> exist_board)) {
-                    cin.clear();
-                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    cout << "Error: Invalid input, please try again." << endl;
-                }
-                else if(exist_board != 'y' && exist_board != 'n')
-                    cout << "Error: You did not enter y or n." << endl;
-                else {
-                    cout << endl;
-                    break;
-                }
-            }
+// Time to solution of a test position file, optionally against a baseline from an earlier --save
+int run_suite(int argc, char *argv[]) {
+    int depth = SUITE_DEFAULT_DEPTH, time_ms = 0, threads = thread::hardware_concurrency(), hash_mb = TT_DEFAULT_MB;
+    string path = (argc > 2) ? argv[2] : "", baseline_path, save_path;
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--depth" && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else if(arg == "--time" && i + 1 < argc)
+            time_ms = atoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(arg == "--hash" && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if(arg == "--baseline" && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if(arg == "--save" && i + 1 < argc)
+            save_path = argv[++i];
+        else
+            path.clear();
+    }
+    if(path.empty() || depth < 1 || time_ms < 0 || hash_mb < 1) {
+        cerr << "Usage: " << argv[0] << " suite <file> [--depth d] [--time ms per position] [--threads n] [--hash mb]" << endl
+             << "       [--baseline results.csv] [--save results.csv]" << endl;
+        return 1;
+    }
+    TestSuite suite;
+    string error;
+    if(!suite.load(path, error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    vector<TestSuite::Result> baseline;
+    if(!baseline_path.empty() && !TestSuite::load_results(baseline_path, baseline)) {
+        cerr << "Error: Cannot read " << baseline_path << endl;
+        return 1;
+    }
+    if(!open_trans_table("", hash_mb))
+        return 1;
+
+    long long start = now_ms();
+    suite.run(depth, time_ms, max(threads, 1));
+    long long ms = now_ms() - start;
+    if(!save_path.empty() && !suite.save(save_path)) {
+        cerr << "Error: Cannot write " << save_path << endl;
+        return 1;
+    }
+    if(!baseline_path.empty())
+        suite.compare(baseline);
+    else
+        cout << "solved " << suite.get_solved() << "/" << suite.get_results().size() << endl;
+    cout << "time " << ms << " ms" << endl;
+    return 0;
+}
 
-            if(exist_board == 'y')
-                cust_board(m_WP,m_BP,m_K,m_turn,cpu_timelimit);
+// Openings, middlegames and endgames for bench, both sides to move
+const char *BENCH_POSITIONS[] = {
+    "B:W21,22,23,24,25,27,28,29,30,31,32:B1,2,3,4,5,7,8,11,12,13,15",
+    "W:W17,18,22,24,25,27,28,29,30,31,32:B1,2,3,4,8,9,10,11,13,15,16",
+    "B:W17,18,20,21,22,24,26,28,29,30,32:B1,2,3,4,9,10,11,13,15,16,19",
+    "W:W13,14,17,20,24,26,28,29,30,32:B1,2,3,5,8,11,15,16,19,23",
+    "B:W10,13,14,20,24,25,26,28,30,32:B1,3,5,6,11,12,15,16,19,23",
+    "W:W10,15,21,26,28,31:B1,3,6,14,19,20",
+    "B:W10,14,15,21,28,31:B1,3,6,18,19,24",
+    "W:W13,K15,19,21:B12,14,K28",
+    "B:WK1,21,K24:B14,K32",
+    "W:WK3,K13,14,26,29,30:B4,K15,21",
+    "B:WK14,19,23,29:B2,12,K26",
+    "W:WK5,K6,K8:BK18,21,26"
+};
 
-            else {
-                init_board(m_WP,m_BP,m_K);
-                while(true) {
-                    cout << "Pick starting player (0 for white, 1 for black): ";
-                    if(!(cin >> m_turn)) {
-                        cin.clear();
-                        cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                        cout << "Error: Invalid input, please try again." << endl;
-                    }
-                    else if(m_turn != 0 && m_turn != 1)
-                        cout << "Error: You entered an number other than 0 or 1." << endl;
-                    else {
-                        cout << endl;
-                        break;
-                    }
-                }
+int run_bench(int argc, char *argv[]) {
+    int depth = 13, hash_mb = TT_DEFAULT_MB, eval_kb = EVAL_CACHE_DEFAULT_KB;
+    UINT64 nodes_limit = 0;
+    string trace_path, shared_hash;
+    for(int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--depth" && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else if(arg == "--nodes" && i + 1 < argc)
+            nodes_limit = strtoull(argv[++i], NULL, 10);
+        else if(arg == "--hash" && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if(arg == "--trace" && i + 1 < argc)
+            trace_path = argv[++i];
+        else if(arg == "--shared-hash" && i + 1 < argc)
+            shared_hash = argv[++i];
+        else if(arg == "--eval-cache" && i + 1 < argc)
+            eval_kb = atoi(argv[++i]);
+        else
+            depth = 0;
+    }
+    if(depth < 1 || hash_mb < 1 || eval_kb < 0) {
+        cerr << "Usage: " << argv[0] << " bench [--depth d] [--nodes n, 0 = no limit] [--hash mb] [--eval-cache kb, 0 = off] [--trace file] [--shared-hash name]" << endl;
+        return 1;
+    }
 
-                //Select CPU time limit
-                if(mode == 2 || mode == 3) {
-                    while(true){
-                        cout << "Designate time limit for CPU (integers only): ";
-                        if (!(cin >> cpu_timelimit)) {
-                            cin.clear();
-                            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                            cout << "Error: Invalid input, please try again." << endl;
-                        }
-                        else if (cpu_timelimit <= 0)
-                            cout << "Error: You entered a negative number" << endl;
-                        else {
-                            cout << endl;
-                            break;
-                        }
-                    }
-                }
-            }
+    // Every position starts from an empty table with the noise off, so the node counts only
+    // change when the search or the evaluation does. A shared table is left as the other
+    // processes have it, and the node counts show what they saved.
+    Game game;
+    game.set_eval_noise(false);
+    game.set_eval_cache(eval_kb);
+    game.set_node_limit(nodes_limit);
+    if(!game.set_trace(trace_path)) {
+        cerr << "Error: Cannot open " << trace_path << endl;
+        return 1;
+    }
+    if(!open_trans_table(shared_hash, hash_mb))
+        return 1;
+    UINT64 total = 0, signature = 0, tt_probes = 0, tt_hits = 0, eval_probes = 0, eval_hits = 0;
+    long long start = now_ms();
+    int count = sizeof(BENCH_POSITIONS) / sizeof(BENCH_POSITIONS[0]);
+    for(int i = 0; i < count; i++) {
+        if(!trans_table.is_shared())
+            trans_table.clear();
+        game.clear_eval_cache();
+        game.set_position(BENCH_POSITIONS[i]);
+        Game::Move best = game.search_position(depth);
+        total += game.get_nodes();
+        tt_probes += game.get_tt_probes();
+        tt_hits += game.get_tt_hits();
+        eval_probes += game.get_eval_probes();
+        eval_hits += game.get_eval_hits();
+        signature = mix64(signature ^ (game.get_nodes() << 10 | best.start << 5 | best.end));
+        cout << "position " << setw(2) << i + 1 << "  best " << game.move_to_pdn(best)
+             << "  depth " << cpu_maxdepth << "  nodes " << game.get_nodes() << endl;
+    }
+    long long ms = max(now_ms() - start, 1LL);
+    cout << "nodes " << total << "  signature " << hex << setw(16) << setfill('0') << signature << dec << setfill(' ')
+         << "  time " << ms << " ms  nps " << total * 1000 / ms << endl;
+    cout << "tt probes " << tt_probes << "  hits " << tt_hits << "  hit rate " << fixed << setprecision(3)
+         << (tt_probes ? double(tt_hits) / tt_probes : 0.0) << endl;
+    cout << "eval cache probes " << eval_probes << "  hits " << eval_hits << "  hit rate "
+         << (eval_probes ? double(eval_hits) / eval_probes : 0.0) << endl;
+    return 0;
+}
 
 
-            //Run game
-            while(get_moves(m_turn,m_WP,m_BP,m_K,end_temp,m_moves)) {
+//
+// MICROBENCHMARKS
+//
+// Per kernel timings of move generation and evaluation, for catching regressions that whole
+// searches hide. A sample times iters passes of a kernel over a set of positions, with iters
+// doubled until a sample takes MICRO_SAMPLE_NS. After the warm-up samples the median and
+// percentiles of ns per call are reported. The positions are split by their legal moves into
+// quiet ones, ones with single captures, and ones with a capture of two or more pieces.
+//
+#define MICRO_SAMPLE_NS 2000000
+#define MICRO_WARMUP_SAMPLES 3
+#define MICRO_DEFAULT_SAMPLES 21
+#define MICRO_QUIET 0
+#define MICRO_CAPTURE 1
+#define MICRO_MULTIJUMP 2
+
+const char *MICRO_SET_NAMES[] = { "quiet", "capture", "multijump" };
+
+// Openings to endgames with each kind of move, both sides to move, besides BENCH_POSITIONS
+const char *MICRO_POSITIONS[] = {
+    "B:W21,22,23,24,25,26,27,28,29,30,31,32:B1,2,3,4,5,6,7,8,9,10,11,12",
+    "W:W18,20,25,28,29,31:B1,4,5,6,8,10,11,K32",
+    "B:W15,18,22,28,29,30,31:B1,4,5,6,7,16,21",
+    "W:WK2,K3,K11,18:BK24,25",
+    "B:W14,21,24:B2,3,4,5,22,23",
+    "W:W11,K12,14,22,23,26,28,29,30:B25",
+    "W:W15,18,21,24,25,32:B1,4,5,8,11,13,14",
+    "B:W18,20,25,27,28,29,31:B1,4,5,6,8,10,11,23",
+    "B:W6,17,25,26,28,29,31,32:B2,3,4,5,7,10,15,19,24",
+    "W:W17,21,24,25,26,27,28,29,30,31,32:B1,2,3,4,5,7,8,9,11,12,18,19",
+    "B:WK3,9:B5,19,27,K30",
+    "B:W16,23,24:B1,6,10,11,12,K26,K30",
+    "B:W5,19,26,27,30,32:B1,4,15,16,20,28",
+    "W:W20,21,22,25,27,28,30:B4,7,9,10,17",
+    "W:WK9,13,21,30:B3,8,12,14,19,K22,23,28",
+    "W:W21,23,24,26,27,28,29:B1,3,4,8,9,12,14,17,25",
+    "B:W5,19,20,21,22,26,27,30,31:B1,3,8,9,11,13,15,16",
+    "B:W9,17,25,26,28,29,30,31,32:B1,2,3,4,5,6,8,19",
+    "W:WK3,17,21,24,25,27,28,29,30,31:B1,4,5,6,7,9,14,15,20",
+    "W:W21,22,24,26,27,28,29,30,31,32:B1,2,3,4,5,6,8,11,13,14,23",
+    "W:WK3:B7,13,14,15,K25"
+};
 
-                cout << endl << endl;
-                cout << "~~~~~~~~~~~~~~~~~~~~~~" << endl;
-                print_turn_info(m_turn,m_turn_num);
-                cout << "~~~~~~~~~~~~~~~~~~~~~~" << endl;
+// Keeps value alive and makes the compiler assume memory changed, so kernels with unused
+// results are neither removed nor hoisted out of the timing loop
+template<typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
 
-                // Player is HUMAN
-                if((m_turn == WHITE && White_Player == HUMAN) || (m_turn == BLACK && BlacK_Player == HUMAN)) {
+struct MicroPosition {
+    UINT WP, BP, K, turn;
+};
 
-                    do {
-                        print_legal_moves(m_moves);
-                        cout << endl;
-                        print_board(m_WP,m_BP,m_K);
-                        cout << endl;
+struct MicroResult {
+    string kernel, set;
+    size_t positions;
+    UINT64 iters;
+    double median_ns, p10_ns, p90_ns, min_ns;
+};
 
-                        while(cout << "Specify move <from> <to> (ex. '6e 5f'): " && !(cin >> row1 >> col1 >> row2 >> col2)) {
-                            cin.clear(); //clear bad input flag
-                            cin.ignore(numeric_limits<streamsize>::max(), '\n'); //discard input
-                            cout << "Error: Invalid input, please try again." << endl;
-                        }
+inline long long now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-                        start = coord_to_bitnum(row1,col1);
-                        end = coord_to_bitnum(row2,col2);
-                    } while(!player_move(start,end));
-                }
+// MICRO_QUIET, MICRO_CAPTURE or MICRO_MULTIJUMP by the moves of the side to move
+int micro_set_of(Game &game, const MicroPosition &p) {
+    vector<Game::Move> moves;
+    UINT end;
+    game.get_moves(p.turn, p.WP, p.BP, p.K, end, moves);
+    bool capture = (p.turn == WHITE ? game.get_jumpers_W(p.WP, p.BP, p.K) : game.get_jumpers_B(p.WP, p.BP, p.K)) != 0;
+    if(!capture)
+        return MICRO_QUIET;
+    for(size_t i = 0; i < moves.size(); i++)
+        if(game.get_bit_count(p.turn == WHITE ? moves[i].BM & p.BP : moves[i].WM & p.WP) >= 2)
+            return MICRO_MULTIJUMP;
+    return MICRO_CAPTURE;
+}
 
-                // Player is COMPUTER
-                else {
-                    print_legal_moves(m_moves);
-                    cout << endl;
-                    print_board(m_WP,m_BP,m_K);
-                    cout << endl;
+// Times pass(position) over every position, see the section comment
+template<typename F>
+MicroResult micro_measure(const string &kernel, const string &set, const vector<MicroPosition> &positions,
+                          int samples, F pass) {
+    MicroResult result = { kernel, set, positions.size(), 1, 0, 0, 0, 0 };
+    if(positions.empty())
+        return result;
+    auto sample = [&]() {
+        long long start = now_ns();
+        for(UINT64 it = 0; it < result.iters; it++)
+            for(size_t i = 0; i < positions.size(); i++)
+                pass(positions[i]);
+        return now_ns() - start;
+    };
+    while(sample() < MICRO_SAMPLE_NS && result.iters < (1ULL << 40))
+        result.iters *= 2;
+    for(int i = 0; i < MICRO_WARMUP_SAMPLES; i++)
+        sample();
+
+    vector<double> ns(samples);
+    double calls = (double)result.iters * positions.size();
+    for(int i = 0; i < samples; i++)
+        ns[i] = sample() / calls;
+    sort(ns.begin(), ns.end());
+    result.median_ns = ns[samples / 2];
+    result.p10_ns = ns[samples / 10];
+    result.p90_ns = ns[samples - 1 - samples / 10];
+    result.min_ns = ns[0];
+    return result;
+}
 
-                    clock_t t1, t2, t1_m, t2_m;
-                    cout << "Computer is thinking..." << endl;
+// Kernel timings over the built in positions or a position file, as a table, CSV or JSON
+int run_microbench(int argc, char *argv[]) {
+    int samples = MICRO_DEFAULT_SAMPLES;
+    string corpus, filter, format = "text";
+    bool ok = true;
+    for(int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--corpus" && i + 1 < argc)
+            corpus = argv[++i];
+        else if(arg == "--samples" && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if(arg == "--csv" || arg == "--json")
+            format = arg.substr(2);
+        else
+            ok = false;
+    }
+    if(!ok || samples < 1) {
+        cerr << "Usage: " << argv[0] << " microbench [--corpus positions.bin|fen.txt] [--samples n] [--filter kernel] [--csv | --json]" << endl;
+        return 1;
+    }
 
-                    t1_m = clock();
-                    computer_move(m_turn == WHITE ? true : false);
-                    t2_m = clock();
+    Game game;
+    game.set_eval_noise(false);
+    vector<MicroPosition> all;
+    if(corpus.empty()) {
+        UINT WP, BP, K, turn;
+        for(const char *fen : BENCH_POSITIONS)
+            if(parse_fen(fen, fen + strlen(fen), WP, BP, K, turn))
+                all.push_back({ WP, BP, K, turn });
+        for(const char *fen : MICRO_POSITIONS)
+            if(parse_fen(fen, fen + strlen(fen), WP, BP, K, turn))
+                all.push_back({ WP, BP, K, turn });
+    }
+    else {
+        PositionFile file;
+        if(!file.open(corpus)) {
+            cerr << "Error: Cannot open " << corpus << endl;
+            return 1;
+        }
+        file.for_each([&](UINT WP, UINT BP, UINT K, UINT turn, UINT /*result*/) {
+            all.push_back({ WP, BP, K, turn });
+        });
+    }
+    vector<MicroPosition> sets[3], multijump_side[2];
+    for(size_t i = 0; i < all.size(); i++) {
+        int set = micro_set_of(game, all[i]);
+        sets[set].push_back(all[i]);
+        if(set == MICRO_MULTIJUMP)
+            multijump_side[all[i].turn].push_back(all[i]);
+    }
 
-                    cpu_time = double(t2_m-t1_m)/CLOCKS_PER_SEC;
-                    print_cpu_stats();
-                }
+    vector<Game::Move> moves;
+    UINT end;
+    vector<MicroResult> results;
+    auto run = [&](const string &kernel, const string &set, const vector<MicroPosition> &positions, auto pass) {
+        if(filter.empty() || kernel.find(filter) != string::npos)
+            results.push_back(micro_measure(kernel, set, positions, samples, pass));
+    };
+    run("get_walkers_W", "all", all, [&](const MicroPosition &p) { do_not_optimize(game.get_walkers_W(p.WP, p.BP, p.K)); });
+    run("get_walkers_B", "all", all, [&](const MicroPosition &p) { do_not_optimize(game.get_walkers_B(p.WP, p.BP, p.K)); });
+    run("get_jumpers_W", "all", all, [&](const MicroPosition &p) { do_not_optimize(game.get_jumpers_W(p.WP, p.BP, p.K)); });
+    run("get_jumpers_B", "all", all, [&](const MicroPosition &p) { do_not_optimize(game.get_jumpers_B(p.WP, p.BP, p.K)); });
+    for(int set = 0; set < 3; set++)
+        run("get_moves", MICRO_SET_NAMES[set], sets[set], [&](const MicroPosition &p) {
+            game.get_moves(p.turn, p.WP, p.BP, p.K, end, moves);
+            do_not_optimize(moves.size());
+        });
+
+    // The padded generator under get_moves(), without converting the moves back
+    vector<Game::PaddedMove> padded_moves;
+    for(int set = 0; set < 3; set++)
+        run("get_padded_moves", MICRO_SET_NAMES[set], sets[set], [&](const MicroPosition &p) {
+            game.get_padded_moves(p.turn, pad_board(p.WP), pad_board(p.BP), pad_board(p.K), end, padded_moves);
+            do_not_optimize(padded_moves.size());
+        });
+
+    // Every jumper of the side to move, as get_padded_moves() calls them
+    auto jumps = [&](const MicroPosition &p) {
+        padded_moves.clear();
+        UINT64 WP = pad_board(p.WP), BP = pad_board(p.BP), K = pad_board(p.K);
+        for(UINT64 jumpers = game.padded_jumpers(p.turn, WP, BP, K); jumpers; jumpers &= jumpers - 1) {
+            UINT sq = __builtin_ctzll(jumpers);
+            game.padded_jumps(p.turn, sq, WP, BP, K, WP, BP, K, sq, end, padded_moves);
+        }
+        do_not_optimize(padded_moves.size());
+    };
+    run("padded_jumps_W", "multijump", multijump_side[WHITE], jumps);
+    run("padded_jumps_B", "multijump", multijump_side[BLACK], jumps);
+    // Every sample after the first finds the corpus in the evaluation cache, so plain
+    // heuristics() is timed with the cache off
+    game.set_eval_cache(0);
+    run("heuristics", "all", all, [&](const MicroPosition &p) { do_not_optimize(game.heuristics(p.WP, p.BP, p.K)); });
+    game.set_eval_cache(EVAL_CACHE_DEFAULT_KB);
+    run("eval_cache_hit", "all", all, [&](const MicroPosition &p) { do_not_optimize(game.heuristics(p.WP, p.BP, p.K)); });
+
+    // Per position cost of evaluating the whole set in batches of BATCH_MAX_MOVES
+    if(!all.empty() && (filter.empty() || string("heuristics_batch").find(filter) != string::npos)) {
+        vector<UINT> WP(all.size()), BP(all.size()), K(all.size());
+        vector<int> values(all.size());
+        for(size_t i = 0; i < all.size(); i++) {
+            WP[i] = all[i].WP;
+            BP[i] = all[i].BP;
+            K[i] = all[i].K;
+        }
+        vector<MicroPosition> one_pass(1);
+        MicroResult batch = micro_measure("heuristics_batch", "all", one_pass, samples, [&](const MicroPosition &) {
+            for(size_t i = 0; i < all.size(); i += BATCH_MAX_MOVES)
+                game.heuristics_batch(&WP[i], &BP[i], &K[i], ::min((size_t)BATCH_MAX_MOVES, all.size() - i), &values[i]);
+            do_not_optimize(values[0]);
+        });
+        batch.positions = all.size();
+        batch.median_ns /= all.size();
+        batch.p10_ns /= all.size();
+        batch.p90_ns /= all.size();
+        batch.min_ns /= all.size();
+        results.push_back(batch);
+    }
 
-                m_turn ^= 1;
-                m_turn_num++;
-            }
+    cout << fixed << setprecision(2);
+    if(format == "csv") {
+        cout << "kernel,set,positions,iterations,samples,median_ns,p10_ns,p90_ns,min_ns" << endl;
+        for(const MicroResult &r : results)
+            cout << r.kernel << "," << r.set << "," << r.positions << "," << r.iters << "," << samples << ","
+                 << r.median_ns << "," << r.p10_ns << "," << r.p90_ns << "," << r.min_ns << endl;
+    }
+    else if(format == "json") {
+        cout << "{\"samples\": " << samples << ", \"batch_lanes\": " << Game::batch_lanes << ", \"results\": [" << endl;
+        for(size_t i = 0; i < results.size(); i++) {
+            const MicroResult &r = results[i];
+            cout << "  {\"kernel\": \"" << r.kernel << "\", \"set\": \"" << r.set << "\", \"positions\": " << r.positions
+                 << ", \"iterations\": " << r.iters << ", \"median_ns\": " << r.median_ns << ", \"p10_ns\": " << r.p10_ns
+                 << ", \"p90_ns\": " << r.p90_ns << ", \"min_ns\": " << r.min_ns << "}" << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        cout << "]}" << endl;
+    }
+    else {
+        cout << "positions " << all.size() << " (" << sets[MICRO_QUIET].size() << " quiet, " << sets[MICRO_CAPTURE].size()
+             << " capture, " << sets[MICRO_MULTIJUMP].size() << " multijump)  samples " << samples
+             << "  batch lanes " << Game::batch_lanes << endl;
+        cout << left << setw(18) << "kernel" << setw(11) << "set" << right << setw(10) << "positions"
+             << setw(12) << "median ns" << setw(10) << "p10" << setw(10) << "p90" << setw(10) << "min" << endl;
+        for(const MicroResult &r : results)
+            cout << left << setw(18) << r.kernel << setw(11) << r.set << right << setw(10) << r.positions
+                 << setw(12) << r.median_ns << setw(10) << r.p10_ns << setw(10) << r.p90_ns << setw(10) << r.min_ns << endl;
+    }
+    return 0;
+}
 
-            //Display winner
-            cout << endl << endl;
-            print_board(m_WP,m_BP,m_K);
-            cout << endl;
-            cout << "+~+~+~+~+~+~+~+~+~+~+~+~+~+~+" << endl;
-            print_winner(m_WP,m_BP);
+// Rebuilds the trees of a search trace and reports where their nodes went
+struct TraceNode {
+    UINT first_child, next_sibling;
+    UINT children;
+    UINT64 subtree;
+};
+#define TRACE_NONE 0xFFFFFFFFu
+
+int run_trace(int argc, char *argv[]) {
+    string path = (argc > 2) ? argv[2] : "";
+    int tree_index = -1, top = 10;
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--tree" && i + 1 < argc)
+            tree_index = atoi(argv[++i]) - 1;
+        else if(arg == "--top" && i + 1 < argc)
+            top = atoi(argv[++i]);
+        else
+            path.clear();
+    }
+    if(path.empty() || top < 0) {
+        cerr << "Usage: " << argv[0] << " trace <file> [--tree n, default the last] [--top n]" << endl;
+        return 1;
+    }
+    MappedFile file;
+    if(!file.open(path) || file.size() < TRACE_MAGIC_SIZE || memcmp(file.data(), TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+        cerr << "Error: " << path << " is not a search trace" << endl;
+        return 1;
+    }
+    const unsigned char *records = (const unsigned char *)file.data() + TRACE_MAGIC_SIZE;
+    size_t count = (file.size() - TRACE_MAGIC_SIZE) / TRACE_RECORD_SIZE;
+    auto rec = [&](UINT i) { return records + (size_t)i * TRACE_RECORD_SIZE; };
+
+    // Children wait at their ply until the parent's record arrives
+    vector<TraceNode> nodes(count);
+    vector<UINT> roots;
+    vector<UINT> pending[MAX_PLY + 2];
+    for(size_t i = 0; i < count; i++) {
+        int ply = rec(i)[24];
+        if(ply > MAX_PLY) {
+            cerr << "Error: Bad record " << i << " in " << path << endl;
+            return 1;
+        }
+        TraceNode &node = nodes[i];
+        node.first_child = node.next_sibling = TRACE_NONE;
+        node.children = pending[ply + 1].size();
+        node.subtree = 1;
+        for(int c = (int)pending[ply + 1].size() - 1; c >= 0; c--) {
+            UINT child = pending[ply + 1][c];
+            nodes[child].next_sibling = node.first_child;
+            node.first_child = child;
+            node.subtree += nodes[child].subtree;
+        }
+        pending[ply + 1].clear();
+        if(ply == 0)
+            roots.push_back(i);
+        else
+            pending[ply].push_back(i);
+    }
+    if(roots.empty()) {
+        cout << "No complete trees in " << count << " records" << endl;
+        return 0;
+    }
 
-            //Prompt to play again
-            while(true) {
-                cout << "Play again (y/n)? ";
-                if(!(cin >> play_again)) {
-                    cin.clear();
-                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    cout << "Error: Invalid input, please try again." << endl;
-                }
-                else if(play_again != 'y' && play_again != 'n')
-                    cout << "Error: You did not enter y or n." << endl;
-                else {
-                    cout << endl;
-                    break;
+    Game game;
+    UINT end;
+    auto position = [&](UINT i, UINT &WP, UINT &BP, UINT &K, UINT &turn) {
+        WP = read_le32(rec(i));
+        BP = read_le32(rec(i) + 4);
+        K = read_le32(rec(i) + 8);
+        turn = (rec(i)[26] & TRACE_BLACK) ? BLACK : WHITE;
+    };
+    auto score = [&](UINT i) { return (int)read_le32(rec(i) + 20); };
+    // Index into the parent's legal moves of the move leading to child, -1 if none does
+    auto move_index = [&](const vector<Game::Move> &moves, UINT WP, UINT BP, UINT K, UINT child) {
+        for(size_t m = 0; m < moves.size(); m++)
+            if(read_le32(rec(child)) == (WP ^ moves[m].WM) && read_le32(rec(child) + 4) == (BP ^ moves[m].BM)
+               && read_le32(rec(child) + 8) == (K ^ moves[m].KM))
+                return (int)m;
+        return -1;
+    };
+
+    cout << count << " records, " << roots.size() << " trees" << endl;
+    for(size_t t = 0; t < roots.size(); t++)
+        cout << "tree " << setw(4) << t + 1 << "  depth " << setw(2) << (int)rec(roots[t])[25]
+             << "  score " << setw(11) << score(roots[t]) << "  nodes " << nodes[roots[t]].subtree << endl;
+    if(tree_index < 0 || tree_index >= (int)roots.size())
+        tree_index = roots.size() - 1;
+    UINT root = roots[tree_index];
+    UINT WP, BP, K, turn;
+    position(root, WP, BP, K, turn);
+    char fen[FEN_MAX_LEN];
+    cout << endl << "Tree " << tree_index + 1 << "  " << string(fen, write_fen(fen, WP, BP, K, turn)) << endl;
+
+    // Walk the tree a ply at a time keeping the line to each node, until the first top cutoffs
+    // have been found with the moves they skipped
+    struct Cutoff {
+        int ply;
+        string line, skipped;
+        int num_skipped;
+    };
+    vector<Cutoff> cutoffs;
+    vector<UINT64> ply_nodes(MAX_PLY + 1), ply_cutoffs(MAX_PLY + 1), ply_first(MAX_PLY + 1), ply_skipped(MAX_PLY + 1);
+    deque<pair<UINT, string> > queue(1, make_pair(root, string()));
+    while(!queue.empty()) {
+        UINT i = queue.front().first;
+        string line = queue.front().second;
+        queue.pop_front();
+        bool collect = cutoffs.size() < (size_t)top;
+        int ply = rec(i)[24];
+        ply_nodes[ply]++;
+        if(nodes[i].first_child == TRACE_NONE)
+            continue;
+
+        position(i, WP, BP, K, turn);
+        vector<Game::Move> moves;
+        game.get_moves(turn, WP, BP, K, end, moves);
+        vector<bool> searched(moves.size());
+        string last_move;
+        for(UINT c = nodes[i].first_child; c != TRACE_NONE; c = nodes[c].next_sibling) {
+            int m = move_index(moves, WP, BP, K, c);
+            if(m >= 0)
+                searched[m] = true;
+            if(collect)
+                last_move = m < 0 ? "?" : game.move_to_pdn(moves[m]);
+            queue.push_back(make_pair(c, collect ? line + (line.empty() ? "" : " ") + last_move : string()));
+        }
+        if(rec(i)[26] & TRACE_CUTOFF) {
+            Cutoff cut = { ply, (line.empty() ? "(root)" : line) + "  " + last_move + " cuts", "", 0 };
+            for(size_t m = 0; m < moves.size(); m++)
+                if(!searched[m]) {
+                    if(collect)
+                        cut.skipped += (cut.num_skipped ? " " : "") + game.move_to_pdn(moves[m]);
+                    cut.num_skipped++;
                 }
-            }
-        } while(play_again == 'y');
+            ply_cutoffs[ply]++;
+            ply_first[ply] += nodes[i].children == 1;
+            ply_skipped[ply] += cut.num_skipped;
+            if(collect && cut.num_skipped)
+                cutoffs.push_back(cut);
+        }
+    }
 
-        return 0;
+    cout << endl << " ply       nodes   cutoffs  first move  skipped moves" << endl;
+    for(int ply = 0; ply <= MAX_PLY && ply_nodes[ply]; ply++)
+        cout << setw(4) << ply << setw(12) << ply_nodes[ply] << setw(10) << ply_cutoffs[ply] << setw(11)
+             << (ply_cutoffs[ply] ? ply_first[ply] * 100 / ply_cutoffs[ply] : 0) << "%" << setw(15) << ply_skipped[ply] << endl;
+
+    // Root moves by the nodes spent below them
+    position(root, WP, BP, K, turn);
+    vector<Game::Move> moves;
+    game.get_moves(turn, WP, BP, K, end, moves);
+    vector<UINT> children;
+    for(UINT c = nodes[root].first_child; c != TRACE_NONE; c = nodes[c].next_sibling)
+        children.push_back(c);
+    stable_sort(children.begin(), children.end(), [&](UINT a, UINT b) { return nodes[a].subtree > nodes[b].subtree; });
+    cout << endl << "root move       score       nodes" << endl;
+    for(UINT c : children) {
+        int m = move_index(moves, WP, BP, K, c);
+        cout << left << setw(10) << (m < 0 ? "?" : game.move_to_pdn(moves[m])) << right << setw(11) << score(c)
+             << setw(12) << nodes[c].subtree << setw(6) << nodes[c].subtree * 100 / nodes[root].subtree << "%" << endl;
     }
-};
 
+    // The heaviest line, following the largest subtree down
+    cout << endl << "heaviest line:";
+    for(UINT i = root; nodes[i].first_child != TRACE_NONE; ) {
+        UINT heaviest = nodes[i].first_child;
+        for(UINT c = heaviest; c != TRACE_NONE; c = nodes[c].next_sibling)
+            if(nodes[c].subtree > nodes[heaviest].subtree)
+                heaviest = c;
+        position(i, WP, BP, K, turn);
+        game.get_moves(turn, WP, BP, K, end, moves);
+        int m = move_index(moves, WP, BP, K, heaviest);
+        cout << " " << (m < 0 ? "?" : game.move_to_pdn(moves[m])) << " (" << nodes[heaviest].subtree << ")";
+        i = heaviest;
+    }
+    cout << endl;
+
+    cout << endl << "pruned lines nearest the root:" << endl;
+    for(size_t i = 0; i < cutoffs.size(); i++)
+        cout << "  " << cutoffs[i].line << ", skipped " << cutoffs[i].skipped << endl;
+    return 0;
+}
+int main(int argc, char *argv[]) {
+    if(argc > 1 && string(argv[1]) == "server")
+        return run_server(argc, argv);
+    if(argc > 1 && string(argv[1]) == "convert")
+        return run_convert(argc, argv);
+    if(argc > 1 && string(argv[1]) == "replay")
+        return run_replay(argc, argv);
+    if(argc > 1 && string(argv[1]) == "analyze")
+        return run_analyze(argc, argv);
+    if(argc > 1 && string(argv[1]) == "tune")
+        return run_tune(argc, argv);
+    if(argc > 1 && string(argv[1]) == "perft")
+        return run_perft(argc, argv);
+    if(argc > 1 && string(argv[1]) == "bench")
+        return run_bench(argc, argv);
+    if(argc > 1 && string(argv[1]) == "solve")
+        return run_solve(argc, argv);
+    if(argc > 1 && string(argv[1]) == "microbench")
+        return run_microbench(argc, argv);
+    if(argc > 1 && string(argv[1]) == "trace")
+        return run_trace(argc, argv);
+    if(argc > 1 && string(argv[1]) == "selfplay")
+        return run_selfplay(argc, argv);
+    if(argc > 1 && string(argv[1]) == "suite")
+        return run_suite(argc, argv);
+    if(argc > 1 && string(argv[1]) == "mcts")
+        return run_mcts(argc, argv);
+    if(argc > 1 && string(argv[1]) == "match")
+        return run_match(argc, argv);
 
-int main() {
     Game CheckersAI_Demo= Game();
+    string table_file;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--pdn" && i + 1 < argc)
+            CheckersAI_Demo.set_pdn_path(argv[++i]);
+        else if(arg == "--draw-moves" && i + 1 < argc)
+            CheckersAI_Demo.set_draw_moves(atoi(argv[++i]));
+        else if(arg == "--pv")
+            CheckersAI_Demo.set_show_pv(true);
+        else if(arg == "--clock" && i + 1 < argc && CheckersAI_Demo.set_clock(argv[i+1]))
+            i++;
+        else if(arg == "--trace" && i + 1 < argc && CheckersAI_Demo.set_trace(argv[i+1]))
+            i++;
+        else if(arg == "--hash-file" && i + 1 < argc)
+            table_file = argv[++i];
+        else {
+            cerr << "Usage: " << argv[0] << " [--pdn games.pdn] [--draw-moves n, 0 = off] [--pv] [--clock [moves/]sec[+inc]] [--trace file] [--hash-file path]" << endl
+                 << "       " << argv[0] << " server | convert | replay | analyze | tune | perft | bench | solve | microbench | trace | selfplay | suite | mcts | match ..." << endl;
+            return 1;
+        }
+    }
+    // Scores with the noise in them would be saved for every later run
+    if(!table_file.empty()) {
+        CheckersAI_Demo.set_eval_noise(false);
+        trans_table.resize(TT_DEFAULT_MB);
+        open_table_file(table_file);
+    }
     CheckersAI_Demo.play();
+    close_table_file(table_file);
     return 0;
 }
\ No newline at end of file
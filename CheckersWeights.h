@@ -0,0 +1,20 @@
+//
+// CheckersWeights.h
+// Multipliers of offset in Game::heuristics()
+// Written by 'CheckersAI tune', rebuild the engine after regenerating
+//
+
+#ifndef CHECKERSWEIGHTS_H
+#define CHECKERSWEIGHTS_H
+
+constexpr int W_PAWN = 2000;           // pawn on its own side or in the neutral rows
+constexpr int W_PAWN_ADVANCED = 2010;  // pawn on the opponent's starting side
+constexpr int W_FIRST_ROW = 10;        // pawn still on its first row
+constexpr int W_KING = 3000;           // king anywhere on the board
+constexpr int W_JUMPER = 100;          // piece that can jump
+constexpr int W_KING_EDGE = 10;        // any king on the edge
+constexpr int W_DBLCORNER = 100;       // endgame, losing side in a double corner
+constexpr int W_ENDGAME_PAWN = 300;    // endgame, per pawn left to the losing side
+constexpr int W_ENDGAME_KING = 500;    // endgame, per king left to the losing side
+
+#endif